@@ -0,0 +1,120 @@
+/*
+****************************************************************************************************
+ADCLIBRARY.H
+
+Autor: Michael Schletz, 22. November 2016
+Desc:  Headerdatei mit den inline Funktionen fr den direkten Zugriff auf den AD Wandler (ohne
+       Scheduler) und dem Delay. Wird beim Einschalten fr die Messung der Referenzspannung
+       verwendet.
+****************************************************************************************************
+*/
+
+#ifndef ADCLIBRARY_H_
+#define ADCLIBRARY_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "UartLibrary.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wartet przise die angegebene Anzahl von Mikrosekunden. Der maximale Wert betrgt bei 16 MHz
+* 17 179, damit die Berechnung nicht berluft. Der minimale Wert darf nicht unter 16 Zyklen 
+* entsprechen, also 16 us bei 1 MHz oder 1 us bei 16 MHz.
+* Erklrung der Berechnung: / 4 weil pro Schleife 4 Zyklen verwendet werden.
+*                           - 3 weil der Overhead 12 Zyklen, also 3 Durchlufen entspricht
+*                           + 500000 damit nicht abgeschnitten, sondern gerundet wird
+* Das ergibt (F_CPU / 4 * val + 500000) / 1000000 - 3
+* Damit die Berechnung nicht berluft, wurde Zhler und Nenner noch durch 16 gekrzt.
+* @param val: Ein Wert von 16 / CPU Clock (in MHz) bis zu 1073 us, der gewartet werden soll.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+#define DELAY_US(val) __asm__ volatile (                                                           \
+  "push R24 \n\t"                         /* Register am Stack sichern */                          \
+  "push R25 \n\t"                         /* (2 Cycles) */                                         \
+  "ldi R24,%[counterLo] \n\t"                                                                      \
+  "ldi R25,%[counterHi] \n\t"                                                                      \
+  "1: sbiw R24,1" "\n\t"     /* Subtract Immediate from Word, 2 Cycles  */                         \
+  "brne 1b \n\t"             /* Branch if Not Equal, 2 Cycles wenn true */                         \
+  "nop \n\t"                 /* Um den fehlenden Sprung auszugleichen (brne hat nur 1 Zyklus */    \
+                             /* fr false, somit braucht jeder Durchlauf 4 Zyklen) */              \
+  "pop R25 \n\t"                                                                                   \
+  "pop R24 \n\t"                                                                                   \
+  "nop \n\t"                 /* Damit 12 Zyklen (durch 4 teilbar) overload entstehen */            \
+  "nop \n\t"                 /* (das entspricht 3 Durchlaeufen */                                  \
+  :                                                                                                \
+  : [counterHi] "M" (((F_CPU / 64ul * val + 31250ul) / 62500ul - 3ul) >> 8),                      \
+    [counterLo] "M" (((F_CPU / 64ul * val + 31250ul) / 62500ul - 3ul) & 0xFF)                     \
+)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Initialisiert den AD Converter fr eine single-ended Messung. Der Prescaler stellt einen Wert fr
+* den ADC Clock auf einen Wert von 50 - 200 kHz ein (bei ADC_PRESCALER 64). Der AD Conversion
+* Complete Interrupt wird aktiviert, damit im Sleep Modus SLEEP_MODE_ADC gemessen werden kann.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void initAdc()
+{
+  ADCSRA = (1 << ADEN) |      // AD Converter aktivieren.
+           (ADC_PRESCALER_LOG2 << ADPS0) | // Prescaler lt. ADC_PRESCALER (s. Doku, S125)
+           (1 << ADIE);       // AD Conversion Complete Interrupt aktivieren.
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liest vom AD Converter. Dabei wird die CPU in den ADC Noise Reduction Sleep Mode geschickt. 
+* Der AD Complete Interrupt weckt sie wieder auf und es kann das Ergebnis aus dem ADC Register
+* gelesen werden. Dieser Vorgang wird mehrmals (je nach dem Wert von NUMBER_OF_MEASUREMENTS)
+* durchgefhrt, um das Ergebnis zu mitteln.
+* Eine Wandlung bentigt 13 Zyklen, wobei 1 Zyklus = CPU-Takt / Prescaler, also rd. 115 kHz ist.
+* @return Gelesener AD Wert (0 - 1023)
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint16_t readAdcValue(ADC_CHANNELS channel)
+{
+  if (channel != ADC_SAME_CHANNEL)
+  {
+    ADMUX = (0b000 << REFS0) | (channel << MUX0); // Vom angegebenen Eingang mit Vcc als 
+                                                  // Referenzspannung lesen.
+  }
+  if (channel == ADC_1V1REF)
+  {
+    DELAY_US(5000);               // 5 ms warten (1ms Mindeszeit lt. Datenblatt).
+  }
+  if (uartIsBusy())
+  {
+    // Der ADC Noise Reduction Sleep Mode wrde den I/O Takt und damit den Timer 0 fr das USI
+    // anhalten. Whrend gesendet wird, wird die Wandlung daher selbst gestartet und im Idle Mode
+    // gewartet. Die USI ISR weckt die CPU dabei fter auf, deshalb wird in einer Schleife
+    // geschlafen. cli/sei verhindert, dass der ADC Interrupt zwischen Prfung und Sleep kommt.
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    ADCSRA |= (1 << ADSC);
+    cli();
+    while (ADCSRA & (1 << ADSC))
+    {
+      sleep_enable();
+      sei();                      // sei wirkt erst nach der nchsten Instruktion, also sleep.
+      sleep_cpu();
+      sleep_disable();
+      cli();
+    }
+    sei();
+  }
+  else
+  {
+    set_sleep_mode(SLEEP_MODE_ADC); // ADC Noise Reduction Sleep Mode einstellen.
+    sleep_mode();                   // Sleepmode starten. 
+  }
+  while (ADCSRA & (1 << ADSC));   // Warten, solange der AD Wandler noch arbeitet. Das 
+                                  // sollte jedoch nicht auftreten. Es kommt nur vor, 
+                                  // wenn ein anderer Interrupt die CPU vor dem Ende der 
+                                  // Konvertierung aufweckt.
+  return ADC;                    // Ergebnis auslesen und zurckliefern.
+}
+
+#endif /* ADCLIBRARY_H_ */
@@ -0,0 +1,386 @@
+/*
+****************************************************************************************************
+ADCSCHEDULER.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Headerdatei mit dem zeitgesteuerten Ablauf der AD Messung. Der Timer 1 lst mit der in
+       SAMPLE_RATE_HZ angegebenen Frequenz einen Compare Match aus, der die Wandlung des ersten
+       Kanals startet. Die ADC ISR liest das Ergebnis und startet sofort den nchsten Kanal. Nach
+       dem letzten Kanal wird adcFrameReady gesetzt und main() kann die Werte senden.
+       Da 1 ms bei 7.3728 MHz keine ganze Anzahl von Timerschritten ist, wird der Compare Wert
+       mit einem Akkumulator (wie beim Bresenham Algorithmus) zwischen 2 Werten umgeschaltet.
+       Der Mittelwert ist dadurch exakt, es muss nichts mehr eingemessen werden.
+       Der Abtastzeitpunkt hngt nicht von der Latenz der ISR ab, solange sie ADSC vor der
+       nchsten Flanke des ADC Takts setzt (ADC_PRESCALER Zyklen nach dem Compare Match, Eintritt
+       und Prolog eingerechnet). Jede Messung liegt dann auf dem Raster der Timerschritte, die
+       Periode wechselt nur zwischen 2 Werten. Kommt die ISR spter, weil gerade die USI ISR
+       luft, verschiebt sich diese Messung um 1 ADC Takt.
+       Bei ADC_OVERSAMPLING_LOG4 n > 0 wird die Sequenz 4^n mal hintereinander gewandelt, die ADC
+       ISR startet die nchste Wandlung also sofort, bis alle fertig sind. Die Werte jedes Kanals
+       werden summiert und die Summe gerundet um ADC_RESULT_SHIFT geschoben (Boxcar Filter mit
+       Dezimierung auf SAMPLE_RATE_HZ, ohne Runden lge der Mittelwert bis zu 1/2 LSB zu tief).
+       Bei ausreichend Rauschen am Eingang (ab rd. 0.5 LSB) bringt jede Vervierfachung 1 Bit
+       Auflsung.
+       Bei REF_TRACKING wird nach der Sequenz auf die 1.1 V Referenz umgeschaltet und der Compare
+       Match B startet deren Wandlung so spt im Intervall, dass sie vor dem nchsten Compare
+       Match A fertig ist. Die Zeit dazwischen (mind. REF_SETTLE_US) dient zum Einschwingen, der
+       5 ms Delay von readAdcValue fllt weg. Die Bandgap wird ber ACBG dauernd eingeschaltet,
+       ihre Anlaufzeit spielt also keine Rolle. Je ADC_REF_AVERAGE Wandlungen werden gemittelt
+       und stehen dann mit readAdcRef() zur Verfgung.
+       Mit einem Kanalplan (CH1_DIVIDER .. CH3_DIVIDER) wandelt jede Messung nur die Kanle, die
+       laut adcPlanMask an der Reihe sind. waitForAdcFrame() liefert die Maske dieser Kanle.
+****************************************************************************************************
+*/
+
+#ifndef ADCSCHEDULER_H_
+#define ADCSCHEDULER_H_
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "Profiling.h"
+
+#ifndef SAMPLE_RATE_HZ
+#error "SAMPLE_RATE_HZ ist nicht definiert"
+#endif
+#ifndef ADC_PRESCALER_LOG2
+#error "ADC_PRESCALER_LOG2 ist nicht definiert"
+#endif
+
+#define ADC_SEQUENCE_LENGTH   3
+#define ADC_OVERSAMPLING      (1 << (2 * ADC_OVERSAMPLING_LOG4))  // Wandlungen pro Kanal
+// Timer 1 luft mit dem Prescaler des ADC (oder einem 2^n Vielfachen davon, wenn das Intervall
+// sonst nicht in 8 Bit passt). Dadurch liegt jeder Compare Match im gleichen Abstand zur nchsten
+// Flanke des ADC Takts, mit der die Wandlung startet.
+#define ADC_TICKS_PER_SEC     (F_CPU / ADC_PRESCALER)
+#if   ADC_TICKS_PER_SEC / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 0
+#elif ADC_TICKS_PER_SEC / 2 / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 1
+#elif ADC_TICKS_PER_SEC / 4 / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 2
+#elif ADC_TICKS_PER_SEC / 8 / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 3
+#elif ADC_TICKS_PER_SEC / 16 / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 4
+#elif ADC_TICKS_PER_SEC / 32 / SAMPLE_RATE_HZ <= 255
+#define SCHED_PRESCALER_EXTRA_LOG2 5
+#else
+#error "SAMPLE_RATE_HZ ist fr diesen ADC_PRESCALER zu klein (Timer 1 hat nur 8 Bit)"
+#endif
+#define SCHED_TICKS_PER_SEC   (ADC_TICKS_PER_SEC >> SCHED_PRESCALER_EXTRA_LOG2)
+#define SCHED_TICKS           (SCHED_TICKS_PER_SEC / SAMPLE_RATE_HZ)   // Ganzzahliger Anteil
+#define SCHED_TICKS_REMAINDER (SCHED_TICKS_PER_SEC % SAMPLE_RATE_HZ)   // Rest fr den Akkumulator
+
+// Die erste Wandlung nach dem Einschalten des ADC dauert 25 statt 13 ADC Takte. Nach ADSC aus der
+// ISR beginnt die Wandlung mit dem nchsten ADC Takt, es wird also 1 Takt mehr gerechnet.
+#define ADC_SEQUENCE_TICKS    (25 + 14 * (ADC_ACTIVE_CHANNELS * ADC_OVERSAMPLING - 1) + 2)
+#if (SCHED_TICKS << SCHED_PRESCALER_EXTRA_LOG2) < ADC_SEQUENCE_TICKS
+#error "SAMPLE_RATE_HZ ist zu gro, die Wandlung aller Kanle dauert lnger als ein Intervall"
+#endif
+
+#if REF_TRACKING
+#define ADC_REF_MUX           ((0b000 << REFS0) | (ADC_1V1REF << MUX0))
+#define ADC_REF_INDEX         (ADC_SEQUENCE_LENGTH + 1)   // adcSequenceIndex whrend der Referenz
+#define ADC_REF_AVERAGE       16   // = BINARY_SLOW_FRAMES, die Summe passt in 16 Bit.
+// Die Referenz startet REF_CONVERSION_TICKS (Timerschritte) vor dem krzesten Intervallende. Die
+// Wandlung dauert 13 ADC Takte + 1 bis zum Start, 3 Takte Reserve fr die Latenz der ISR.
+#define REF_CONVERSION_TICKS  ((17 + (1 << SCHED_PRESCALER_EXTRA_LOG2) - 1) >> \
+                               SCHED_PRESCALER_EXTRA_LOG2)
+#define REF_START_TICK        (SCHED_TICKS - 1 - REF_CONVERSION_TICKS)
+#define REF_SETTLE_TICKS      ((ADC_TICKS_PER_SEC * REF_SETTLE_US + 999999) / 1000000)
+#if (REF_START_TICK << SCHED_PRESCALER_EXTRA_LOG2) < ADC_SEQUENCE_TICKS + REF_SETTLE_TICKS
+#error "Keine Zeit fr die Referenz im Intervall, SAMPLE_RATE_HZ verkleinern oder REF_TRACKING 0"
+#endif
+#endif
+
+// Reihenfolge der Kanle. adcFrame[i] bekommt den Wert von adcSequence[i].
+static const uint8_t adcSequence[ADC_SEQUENCE_LENGTH] =
+{
+  (0b000 << REFS0) | (ADC_PB2 << MUX0),
+  (0b000 << REFS0) | (ADC_PB3 << MUX0),
+  (0b000 << REFS0) | (ADC_PB4 << MUX0)
+};
+
+#if CHANNEL_PLAN
+// Kanle (Bit 0 = adcFrame[0]) und erster Kanal fr jede Messung im Zyklus des Kanalplans. Bei der
+// ersten Messung des Zyklus sind alle aktiven Kanle dran.
+#define ADC_PLAN_ACTIVE(d, tick) ((d) != 0 && !((tick) & ((d) - 1)))
+#define ADC_PLAN_MASK(tick)   (ADC_PLAN_ACTIVE(CH1_DIVIDER, tick) | \
+                               (ADC_PLAN_ACTIVE(CH2_DIVIDER, tick) << 1) | \
+                               (ADC_PLAN_ACTIVE(CH3_DIVIDER, tick) << 2))
+#define ADC_PLAN_FIRST(tick)  ((ADC_PLAN_MASK(tick) & 1) ? 0 : (ADC_PLAN_MASK(tick) & 2) ? 1 : 2)
+static const uint8_t adcPlanMask[CHANNEL_PLAN_CYCLE] =
+  { ADC_PLAN_MASK(0), ADC_PLAN_MASK(1), ADC_PLAN_MASK(2), ADC_PLAN_MASK(3) };
+static const uint8_t adcPlanFirst[CHANNEL_PLAN_CYCLE] =
+  { ADC_PLAN_FIRST(0), ADC_PLAN_FIRST(1), ADC_PLAN_FIRST(2), ADC_PLAN_FIRST(3) };
+#endif
+
+static volatile uint16_t adcFrame[ADC_SEQUENCE_LENGTH];
+#if REF_TRACKING
+static volatile uint16_t adcRef;               // Mittelwert mit ADC_RESULT_BITS
+static volatile uint8_t adcRefReady = 0;
+static uint16_t adcRefSum = 0;                 // Nur in der ADC ISR verwendet.
+static uint8_t adcRefCount = ADC_REF_AVERAGE;
+#endif
+static volatile uint8_t adcSequenceIndex = ADC_SEQUENCE_LENGTH;   // = Lnge: Keine Sequenz aktiv.
+static volatile uint8_t adcFrameReady = 0;
+static uint16_t schedAccumulator = 0;
+#if CHANNEL_PLAN
+static volatile uint8_t adcChannels;           // Kanle der laufenden Messung
+static uint8_t adcFirstIndex;                  // Erster Kanal der laufenden Messung
+static uint8_t adcPlanTick = 0;                // Position der nchsten Messung im Zyklus
+#define ADC_FIRST_INDEX       adcFirstIndex
+#define ADC_NEXT_FIRST_INDEX  adcPlanFirst[adcPlanTick]
+#define ADC_NEXT_INDEX(index) adcNextIndex(index)
+#else
+#define ADC_FIRST_INDEX       0
+#define ADC_NEXT_FIRST_INDEX  0
+#define ADC_NEXT_INDEX(index) ((index) + 1)
+#endif
+#if ADC_OVERSAMPLING_LOG4
+static uint16_t adcSum[ADC_SEQUENCE_LENGTH];   // Nur in der ADC ISR verwendet.
+static volatile uint8_t adcRoundsLeft = 0;     // Noch zu wandelnde Durchlufe der Sequenz
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ISR fr den Compare Match A des Timer 1. Startet die Wandlung des ersten Kanals, gibt den
+* Sampletakt am MILLISEC_PIN aus und stellt die Lnge des nchsten Intervalls ein.
+* Die ISR luft mit freigegebenen Interrupts, damit die USI ISR nicht verzgert wird.
+* @param TIMER1_COMPA_vect: Interruptvektor aus interrupt.h
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER1_COMPA_vect, ISR_NOBLOCK)
+{
+  ADCSRA |= (1 << ADSC);           // Als Erstes, damit der Abtastzeitpunkt immer gleich ist.
+  PROFILE_ISR_ENTER(PROFILE_ISR_TIMER1);
+#if CHANNEL_PLAN
+  adcFirstIndex = adcPlanFirst[adcPlanTick];
+  adcChannels = adcPlanMask[adcPlanTick];
+  adcSequenceIndex = adcFirstIndex;
+  adcPlanTick = (adcPlanTick + 1) & (CHANNEL_PLAN_CYCLE - 1);
+#else
+  adcSequenceIndex = 0;
+#endif
+#if ADC_OVERSAMPLING_LOG4
+  adcRoundsLeft = ADC_OVERSAMPLING;
+#endif
+  PINB |= (1 << MILLISEC_PIN);     // Toggle Pin, also den Sampletakt ausgeben.
+
+  // Das Intervall dauert OCR1C + 1 Timerschritte. Der Rest wird aufsummiert, luft er ber,
+  // dauert das Intervall 1 Schritt lnger. Der Timer steht gerade auf 0, deshalb gilt der neue
+  // Wert schon fr das laufende Intervall.
+#if SCHED_TICKS_REMAINDER
+  schedAccumulator += SCHED_TICKS_REMAINDER;
+  if (schedAccumulator >= SAMPLE_RATE_HZ)
+  {
+    schedAccumulator -= SAMPLE_RATE_HZ;
+    OCR1C = SCHED_TICKS;
+  }
+  else
+  {
+    OCR1C = SCHED_TICKS - 1;
+  }
+#endif
+  PROFILE_ISR_LEAVE(PROFILE_ISR_TIMER1);
+}
+
+#if CHANNEL_PLAN
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Sucht den nchsten Kanal der laufenden Messung.
+* @param index: Zuletzt gewandelter Kanal.
+* @return Index des nchsten Kanals oder ADC_SEQUENCE_LENGTH, wenn keiner mehr dran ist.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t adcNextIndex(uint8_t index)
+{
+  do
+  {
+    index++;
+  } while (index < ADC_SEQUENCE_LENGTH && !(adcChannels & (1 << index)));
+  return index;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ISR fr den AD Conversion Complete Interrupt. Speichert das Ergebnis und startet den nchsten
+* Kanal der Sequenz. Auerhalb einer Sequenz (z. B. bei readAdcValue) weckt sie nur die CPU auf.
+* Nicht lschen, sonst wird beim ersten Aufrufen des Interrupts das Programm beendet, da eine
+* ungltige Sprungadresse in der ISR Tabelle ist!
+* @param ADC_vect: Interruptvektor aus interrupt.h
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+ISR(ADC_vect, ISR_NOBLOCK)
+{
+  uint8_t index = adcSequenceIndex;
+
+  PROFILE_ISR_ENTER(PROFILE_ISR_ADC);
+  if (index < ADC_SEQUENCE_LENGTH)
+  {
+#if ADC_OVERSAMPLING_LOG4
+    adcSum[index] += ADC;
+    index = ADC_NEXT_INDEX(index);
+    if (index == ADC_SEQUENCE_LENGTH && --adcRoundsLeft)
+    {
+      index = ADC_FIRST_INDEX;     // Nchster Durchlauf
+    }
+    else if (index == ADC_SEQUENCE_LENGTH)
+    {
+      for (index = 0; index < ADC_SEQUENCE_LENGTH; index++)
+      {
+        adcFrame[index] = (adcSum[index] + ADC_RESULT_ROUND) >> ADC_RESULT_SHIFT;
+        adcSum[index] = 0;
+      }
+    }
+#else
+    adcFrame[index] = ADC;
+    index = ADC_NEXT_INDEX(index);
+#endif
+    if (index < ADC_SEQUENCE_LENGTH)
+    {
+      ADMUX = adcSequence[index];
+      ADCSRA |= (1 << ADSC);
+    }
+    else
+    {
+#if REF_TRACKING
+      ADMUX = ADC_REF_MUX;         // Einschwingen bis zum Compare Match B.
+#else
+      ADMUX = adcSequence[ADC_NEXT_FIRST_INDEX];   // Fr den nchsten Compare Match vorbereiten.
+#endif
+      adcFrameReady = 1;
+    }
+    adcSequenceIndex = index;
+  }
+#if REF_TRACKING
+  else if (index == ADC_REF_INDEX)
+  {
+    ADMUX = adcSequence[ADC_NEXT_FIRST_INDEX];
+    adcSequenceIndex = ADC_SEQUENCE_LENGTH;
+    adcRefSum += ADC;
+    if (!--adcRefCount)
+    {
+      // Summe von 16 Wandlungen mit 14 Bit, auf die Auflsung der Kanle bringen.
+      adcRef = adcRefSum >> (4 - (ADC_RESULT_BITS - 10));
+      adcRefReady = 1;
+      adcRefSum = 0;
+      adcRefCount = ADC_REF_AVERAGE;
+    }
+  }
+#endif
+  PROFILE_ISR_LEAVE(PROFILE_ISR_ADC);
+}
+
+#if REF_TRACKING
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ISR fr den Compare Match B des Timer 1. Startet die Wandlung der Referenz, wenn die Sequenz
+* fertig ist. ADMUX steht schon seit dem Ende der Sequenz auf der Referenz. Vor dem ersten
+* Compare Match A steht ADMUX noch auf dem ersten Kanal, dann wird nichts gewandelt.
+* @param TIMER1_COMPB_vect: Interruptvektor aus interrupt.h
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+ISR(TIMER1_COMPB_vect, ISR_NOBLOCK)
+{
+  PROFILE_ISR_ENTER(PROFILE_ISR_TIMER1);
+  if (adcSequenceIndex == ADC_SEQUENCE_LENGTH && ADMUX == ADC_REF_MUX)
+  {
+    adcSequenceIndex = ADC_REF_INDEX;
+    ADCSRA |= (1 << ADSC);
+  }
+  PROFILE_ISR_LEAVE(PROFILE_ISR_TIMER1);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert den Mittelwert der 1.1 V Referenz, wenn seit dem letzten Aufruf ein neuer vorliegt.
+* @param refPtr: Ziel, bleibt ohne neuen Wert unverndert.
+* @return 1, wenn ein neuer Wert geschrieben wurde.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t readAdcRef(uint16_t *refPtr)
+{
+  if (!adcRefReady) return 0;
+  cli();
+  *refPtr = adcRef;
+  adcRefReady = 0;
+  sei();
+  return 1;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Startet den Timer 1 fr den Sampletakt. Die Prescaler von Timer 1 und ADC werden dabei
+* gleichzeitig zurckgesetzt, damit sie synchron laufen. initAdc() muss vorher aufgerufen werden.
+* Timer 1 zhlt im CTC Modus bis OCR1C, der Compare Match A bei 0 lst die ISR aus.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void initAdcScheduler()
+{
+  adcSequenceIndex = ADC_SEQUENCE_LENGTH;
+  adcFrameReady = 0;
+  ADMUX = adcSequence[ADC_NEXT_FIRST_INDEX];
+  OCR1A = 0;
+  OCR1C = SCHED_TICKS - 1;
+  TCNT1 = 0;
+  ADCSRA &= ~(1 << ADEN);          // Der ADC Prescaler steht, solange ADEN 0 ist.
+  GTCCR = (1 << PSR1);             // Prescaler von Timer 1 zurcksetzen.
+  ADCSRA |= (1 << ADEN);
+  TCCR1 = (1 << CTC1) | ((ADC_PRESCALER_LOG2 + SCHED_PRESCALER_EXTRA_LOG2 + 1) << CS10);
+  TIMSK |= (1 << OCIE1A);
+#if REF_TRACKING
+  ACSR = (1 << ACBG);              // Bandgap ber den Analog Comparator dauernd einschalten.
+  OCR1B = REF_START_TICK;
+  TIMSK |= (1 << OCIE1B);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schickt die CPU in den Idle Sleep Mode, bis alle Kanle gewandelt wurden und kopiert dann die
+* Werte. Der ADC Noise Reduction Mode kann nicht verwendet werden, da er Timer 0 und 1 anhlt.
+* cli/sei verhindert, dass die ADC ISR zwischen Prfung und Sleep kommt.
+* @param valuesPtr: Pointer auf ein Array mit ADC_SEQUENCE_LENGTH Elementen. Kanle, die laut
+*                   Kanalplan nicht gewandelt wurden, haben noch den alten Wert.
+* @return Maske der gewandelten Kanle (Bit 0 = valuesPtr[0]), ohne Kanalplan CHANNEL_ALL.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t waitForAdcFrame(uint16_t *valuesPtr)
+{
+  uint8_t count;
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  while (!adcFrameReady)
+  {
+    sleep_enable();
+    sei();                         // sei wirkt erst nach der nchsten Instruktion, also sleep.
+    sleep_cpu();
+    sleep_disable();
+    cli();
+  }
+  adcFrameReady = 0;
+  sei();
+  // Die nchste Sequenz startet erst mit dem nchsten Compare Match, die Werte bleiben also
+  // bis dahin stabil.
+  for (count = 0; count < ADC_SEQUENCE_LENGTH; count++)
+  {
+    valuesPtr[count] = adcFrame[count];
+  }
+#if CHANNEL_PLAN
+  return adcChannels;
+#else
+  return CHANNEL_ALL;
+#endif
+}
+
+#endif /* ADCSCHEDULER_H_ */
@@ -0,0 +1,117 @@
+/*
+****************************************************************************************************
+BURSTCAPTURE.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Headerdatei fr den Burst Modus (BURST_MODE 1). Die Messwerte werden nicht sofort gesendet,
+       sondern in einen Ringpuffer im SRAM geschrieben. berschreitet der Kanal
+       BURST_TRIGGER_CHANNEL den Wert BURST_TRIGGER_LEVEL, werden noch BURST_POST_SAMPLES
+       Messungen aufgezeichnet. Danach kann der Puffer in Ruhe gesendet werden.
+       Da der ATtiny45 nur 256 Bytes SRAM hat, werden nur die oberen 8 Bit jedes Kanals
+       gespeichert (3 Bytes pro Messung). Bei ADC_PRESCALER 16 oder 8 ist die Auflsung des ADC
+       ohnehin nicht hher.
+****************************************************************************************************
+*/
+
+#ifndef BURSTCAPTURE_H_
+#define BURSTCAPTURE_H_
+
+#include <stdint.h>
+
+#ifndef BURST_SAMPLES
+#error "BURST_SAMPLES ist nicht definiert"
+#endif
+#if BURST_POST_SAMPLES >= BURST_SAMPLES
+#error "BURST_POST_SAMPLES muss kleiner als BURST_SAMPLES sein"
+#endif
+// Der Rest des SRAM wird fr den Sendepuffer, die Variablen und den Stack gebraucht.
+#if BURST_SAMPLES * 3 + UART_TX_BUFFER_SIZE > 170
+#error "BURST_SAMPLES ist zu gro fr das SRAM des ATtiny45"
+#endif
+
+#define BURST_PRE_SAMPLES (BURST_SAMPLES - BURST_POST_SAMPLES)
+
+static uint8_t burstBuffer[BURST_SAMPLES][3];
+static uint8_t burstWriteIndex = 0;        // Nchster Platz, ist auch die lteste Messung.
+static uint8_t burstStored = 0;            // Anzahl der gltigen Messungen bis BURST_PRE_SAMPLES.
+static uint8_t burstPostCount = 0;         // Noch aufzuzeichnende Messungen nach dem Trigger.
+static uint8_t burstTriggered = 0;
+static uint16_t burstLastValue = 0;        // Voriger Wert des Triggerkanals
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schreibt eine Messung in den Ringpuffer und prft den Trigger. Der Trigger wird erst scharf,
+* wenn BURST_PRE_SAMPLES Messungen im Puffer sind.
+* @param valuesPtr: Ch1, Ch2, Ch3 (10 Bit).
+* @return 1, wenn nach dem Trigger alle BURST_POST_SAMPLES Messungen aufgezeichnet wurden.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t burstStore(const uint16_t *valuesPtr)
+{
+  uint16_t triggerValue = valuesPtr[BURST_TRIGGER_CHANNEL - 1];
+  uint8_t *slotPtr = burstBuffer[burstWriteIndex];
+
+  slotPtr[0] = valuesPtr[0] >> 2;
+  slotPtr[1] = valuesPtr[1] >> 2;
+  slotPtr[2] = valuesPtr[2] >> 2;
+  if (++burstWriteIndex == BURST_SAMPLES) burstWriteIndex = 0;
+
+  if (burstTriggered)
+  {
+    return --burstPostCount == 0;
+  }
+  if (burstStored < BURST_PRE_SAMPLES)
+  {
+    burstStored++;
+  }
+#if BURST_TRIGGER_RISING
+  else if (burstLastValue < BURST_TRIGGER_LEVEL && triggerValue >= BURST_TRIGGER_LEVEL)
+#else
+  else if (burstLastValue > BURST_TRIGGER_LEVEL && triggerValue <= BURST_TRIGGER_LEVEL)
+#endif
+  {
+    // Die Triggermessung zhlt schon zu den Messungen vor dem Trigger.
+    burstTriggered = 1;
+    burstPostCount = BURST_POST_SAMPLES;
+    if (!burstPostCount) return 1;
+  }
+  burstLastValue = triggerValue;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liest eine Messung aus dem Ringpuffer. Index 0 ist die lteste Messung, die Triggermessung hat
+* den Index BURST_PRE_SAMPLES - 1. Die Werte werden wieder auf 10 Bit skaliert.
+* @param index: 0 bis BURST_SAMPLES - 1.
+* @param valuesPtr: Ch1, Ch2, Ch3.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void burstReadSample(uint8_t index, uint16_t *valuesPtr)
+{
+  uint8_t position = burstWriteIndex + index;
+  uint8_t *slotPtr;
+
+  if (position >= BURST_SAMPLES) position -= BURST_SAMPLES;
+  slotPtr = burstBuffer[position];
+  valuesPtr[0] = slotPtr[0] << 2;
+  valuesPtr[1] = slotPtr[1] << 2;
+  valuesPtr[2] = slotPtr[2] << 2;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Startet eine neue Aufzeichnung. Der Puffer muss vorher komplett gefllt werden, bevor der
+* Trigger wieder scharf ist.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void burstRearm()
+{
+  burstStored = 0;
+  burstTriggered = 0;
+  burstPostCount = 0;
+}
+
+#endif /* BURSTCAPTURE_H_ */
@@ -1,6 +1,8 @@
 /* 
 *************************************************************************************************
 CRASHWAGERL: 3 Kanal 10bit A/D Wandler mit Samplingintervall von 1 ms und 460 800 bit/s UART.
+             Das Samplingintervall wird vom Timer 1 erzeugt und kann mit SAMPLE_RATE_HZ
+             eingestellt werden.
 
 Autor: Michael Schletz, 21. November 2016
 Desc:  Liest jede Millisekunde den Analogwert der Pins PC2, PB3 und PB4 und sendet ihn mit einem 
@@ -8,9 +10,10 @@ Desc:  Liest jede Millisekunde den Analogwert der Pins PC2, PB3 und PB4 und send
        in Bezug zur Betriebsspannung gemessen. So kann der absolute Spannungswert berechnet werden.
        
        Wichtig fr das Programmieren von neuen Chips: Beim Attiny muss, um einen 16 MHz Takt zu 
-       erhalten, die Fuse CLCK DIV8 deaktiviert werden. Danach muss der Wert von OSCILLATOR_CAL 
-       so gesetzt werden, dass die CPU mit einem Takt von 7.3728 MH arbeitet. So kann mit 
-       460 800 bit/s bertragen werden.
+       erhalten, die Fuse CLCK DIV8 deaktiviert werden. Danach muss der Oszillator so kalibriert
+       werden, dass die CPU mit einem Takt von 7.3728 MH arbeitet. So kann mit 460 800 bit/s 
+       bertragen werden. Dazu beim ersten Einschalten ein 1 kHz Rechtecksignal (0 - Vcc) an PB2
+       anlegen, der Wert wird dann im EEPROM gespeichert (s. OszillatorCalibration.h).
 
        Die UART Nachricht ist ein ASCII String, der mit \r\n beendet wird. Die Werte fr den 
        Timecode und den ADC Messwert werden BASE64 codiert. Dabei werden die ersten 4 Stellen
@@ -36,35 +39,99 @@ Pinout:
                       RESET |1    8| VCC
 Analog in Channel 2 --> PB3 |2    7| PB2 <-- Analog in Channel 1
 Analog in Channel 3 --> PB4 |3    6| PB1 --> UART TX
-                        GND |4    5| PB0 --> Ms Takt (Toggle bei Compare Match)
+                        GND |4    5| PB0 --> Ms Takt (Toggle bei jeder Messung)
                             +------+
 
 *************************************************************************************************
 */
 #include "Crashwagerl.h"
+#include "Hal.h"
+#if BURST_MODE
+#include "BurstCapture.h"
+#endif
 
+static uint8_t message[MESSAGE_LENGTH];
+#if FRAME_FORMAT == FRAME_FORMAT_DELTA
+static DELTA_ENCODER deltaEncoder = {{0, 0, 0}, 0};
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
-* (Leere) ISR fr den ADC Complete Interrupt. Muss vorhanden sein, da vor der AD Konvertierung
-* der Sleep Mode fr die ADC Noise Reduktion aufgerufen wird. Nicht lschen, sonst wird beim
-* ersten Aufrufen des Interrupts das Programm beendet, da eine ungltige Sprungadresse in der ISR
-* Tabelle ist!
-* @param ADC_vect: Interruptvektor aus interrupt.h
+* Codiert eine Messung im eingestellten FRAME_FORMAT und bergibt sie dem Sendepuffer. Die USI
+* ISR sendet sie, whrend schon die nchste Messung luft.
+* @param timecode: Timecode der Messung.
+* @param valuesPtr: Ref, Ch1, Ch2, Ch3.
+* @param channels: Maske der gewandelten Kanle, nur mit Kanalplan verwendet.
 * @return void
 */
-ISR(ADC_vect)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void sendSample(uint32_t timecode, const uint16_t *valuesPtr, uint8_t channels)
 {
+#if !CHANNEL_PLAN
+  (void)channels;
+#endif
+#if FRAME_FORMAT == FRAME_FORMAT_BINARY && CHANNEL_PLAN
+  // Nur die gewandelten Kanle senden, 5 - 7 Bytes. Der Plan geht im Slow Word mit.
+  uint8_t len = encodeBinaryPlanFrame(message, timecode, valuesPtr, channels, CHANNEL_PLAN_CODE);
+  PROFILE_STAGE(PROFILE_SEND);
+  uartSendBytes(message, len);
+#elif FRAME_FORMAT == FRAME_FORMAT_BINARY
+  // 7 Bytes mit Sync, 8 Bit Timecode, den 3 Kanlen und CRC. Der restliche Timecode und der
+  // Referenzwert werden verteilt auf 16 Nachrichten bertragen (s. FrameFormat.h).
+  encodeBinaryFrame(message, timecode, valuesPtr[0], valuesPtr[1], valuesPtr[2], valuesPtr[3]);
+  PROFILE_STAGE(PROFILE_SEND);
+  uartSendBytes(message, MESSAGE_LENGTH);
+#elif FRAME_FORMAT == FRAME_FORMAT_DELTA
+  // Alle DELTA_KEYFRAME_INTERVAL Messungen ein Keyframe mit allen Werten, dazwischen nur die
+  // Differenzen mit 1 - 4 Bytes (s. FrameFormat.h). Der Timecode beginnt bei 0, daher ist die
+  // erste Nachricht ein Keyframe.
+  uint8_t len = encodeDeltaSample(&deltaEncoder, message, timecode, valuesPtr);
+  PROFILE_STAGE(PROFILE_SEND);
+  uartSendBytes(message, len);
+#else
+  // Die unteren 24 Bit als MS Wert als Base64 ASCII senden. Das sind Base64 Codiert 4 Zeichen.
+  // Der Timer luft also nach 4h 40m ber. Danach die unteren 12 Bit von Ref, PB2, PB3 und PB4
+  // mit je 2 Zeichen. Die Zeichen kommen schon umgedreht aus einer Tabelle, Codieren und Senden
+  // brauchen so fr jeden Wert gleich viele Zyklen.
+  encodeBase64Frame(message, timecode, valuesPtr);
+  PROFILE_STAGE(PROFILE_SEND);
+  uartSendReversedBytes(message, MESSAGE_LENGTH);
+#endif
+}
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Sendet im Binrformat die Prambel mit dem ganzen Slow Word (s. FrameFormat.h). Der Empfnger
+* kennt damit Timecode, Referenz und Kanalplan schon ab der folgenden Nachricht. In den anderen
+* Formaten wird nichts gesendet.
+* @param timecode: Timecode der folgenden Nachricht.
+* @param refValue: Wert der internen 1.1V Referenzspannung.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void sendPreamble(uint32_t timecode, uint16_t refValue)
+{
+#if FRAME_FORMAT == FRAME_FORMAT_BINARY
+  encodeBinaryPreamble(message, timecode, refValue, CHANNEL_PLAN_CODE);
+  uartSendBytes(message, BINARY_PREAMBLE_LENGTH);
+#else
+  (void)timecode;
+  (void)refValue;
+#endif
 }
 
 int main(void)
 {
-  char message[15] = "            \r\n";
   uint8_t count;
   uint16_t adcValues[4];
-  uint32_t msCounter = 0;
+#if !BURST_MODE
+  uint8_t channels;            // Vom Kanalplan gewandelte Kanle
+  uint32_t msCounter = 0;      // Zhlt die Messungen, bei SAMPLE_RATE_HZ 1000 also die ms.
+#endif
 
-  // Internen Oszillator konfigurieren, damit die Zielfrequenz erreicht wird.
-  OSCCAL = OSCILLATOR_CAL;         
+  // Internen Oszillator konfigurieren, damit die Zielfrequenz erreicht wird. Liegt am
+  // OSCCAL_REF_PIN ein Referenzsignal an, wird dabei neu kalibriert.
+  initOscillator();
 
   DDRB = (1 << MILLISEC_PIN);   // MILLISEC_PIN als Output definieren.
   
@@ -74,7 +141,8 @@ int main(void)
 
   // Den Wert der internen 1.1 V Referenzspannung lesen. Damit kann auf die Referenzspannung fr die
   // AD Messung (Vcc) geschlossen werden. Nach dem Wechsel zur internen Referenzspannung braucht der
-  // ADC allerdings lt. Datenblatt 1ms. Deshalb kann nur am Anfang der Wert gemessen werden.
+  // ADC allerdings lt. Datenblatt 1ms. Hier wird der Startwert gemessen, bei REF_TRACKING
+  // aktualisiert ihn danach der Scheduler (s. AdcScheduler.h).
   DELAY_US(5000);                           // 5 ms warten bis sich die Betriebsspannung 
                                             // stabilisiert hat.
   adcValues[0] = readAdcValue(ADC_1V1REF);
@@ -82,37 +150,59 @@ int main(void)
   {
     adcValues[0] += readAdcValue(ADC_SAME_CHANNEL);
   }
-  adcValues[0] /= 64;
+  adcValues[0] >>= 6 - (ADC_RESULT_BITS - 10);  // Mittelwert mit der Auflsung der Kanle
+
+  // Die Prambel ist gesendet, bevor die erste Messung fertig ist. Sie zhlt daher nicht zur
+  // bertragungszeit der Messungen.
+  sendPreamble(0, adcValues[0]);
+  uartFlush();
+
+  // Ab jetzt startet der Timer 1 die Messungen. main() wartet nur mehr auf die Werte und sendet
+  // sie, es muss kein Durchlauf mehr gleich lang sein.
+  initAdcScheduler();
 
   while (1) 
   {
-    PINB |= (1 << MILLISEC_PIN);         // Toggle Pin, also den ms Takt ausgeben.
-
-    adcValues[1] = readAdcValue(ADC_PB2);
-    adcValues[2] = readAdcValue(ADC_PB3);
-    adcValues[3] = readAdcValue(ADC_PB4);
-
-    // Die unteren 24 Bit als MS Wert als Base64 ASCII senden. Das sind Base64 Codiert 4 Zeichen.
-    // Der Timer luft also nach 4h 40m ber.
-    uint32ToBase64(msCounter, message, 4);
-    // Die unteren 12 Bit des ADC Wertes als Base64 senden. Das sind 2 Zeichen.
-    uint16ToBase64(adcValues[0], message+4, 2);   // Wert der internen 1.1V Referenzspannung
-    uint16ToBase64(adcValues[1], message+6, 2);   // Wert von PB2
-    uint16ToBase64(adcValues[2], message+8, 2);   // Wert von PB3
-    uint16ToBase64(adcValues[3], message+10, 2);  // Wert von PB4
-    uartSendMessage(message);
-
+    // Das Holen des Referenzwertes zhlt noch zum Warten, damit Codieren und Senden in jeder
+    // Messung gleich viele Zyklen brauchen (s. crashprofile -k).
+    PROFILE_STAGE(PROFILE_WAIT);
+#if BURST_MODE
+    waitForAdcFrame(adcValues+1);     // Werte von PB2, PB3 und PB4.
+#if REF_TRACKING
+    readAdcRef(adcValues);
+#endif
+#else
+    channels = waitForAdcFrame(adcValues+1);
+#if REF_TRACKING
+    // Nur am Anfang eines Slow Words (Binrformat) bzw. Keyframe Blocks wechseln, damit ein
+    // Wert nie aus 2 Messungen zusammengesetzt wird.
+    if (!((uint8_t)msCounter & (BINARY_SLOW_FRAMES - 1)))
+    {
+      readAdcRef(adcValues);
+    }
+#endif
+#endif
+    PROFILE_STAGE(PROFILE_ENCODE);
+
+#if BURST_MODE
+    // Aufzeichnen, bis der Trigger ausgelst hat und alle Messungen danach im Puffer sind. Dann
+    // den Puffer senden. Der Timecode beginnt bei jedem Burst mit 0, die Triggermessung hat den
+    // Timecode BURST_PRE_SAMPLES - 1.
+    if (burstStore(adcValues+1))
+    {
+      sendPreamble(0, adcValues[0]);
+      for (count = 0; count < BURST_SAMPLES; count++)
+      {
+        burstReadSample(count, adcValues+1);
+        sendSample(count, adcValues, CHANNEL_ALL);
+      }
+      uartFlush();
+      burstRearm();
+    }
+#else
+    sendSample(msCounter, adcValues, channels);
     msCounter++;
-
-    // Hier wird gewartet, bis 1 ms komplett ist. Da die CPU whrend der Messung in den Sleepmode
-    // geht, und das Programm sowieso alles synchron abarbeitet, ist diese Lsung genauer als ein
-    // Timer. Der Compare Match des Timers kann nur von 0-255 eingestellt werden und ist daher nicht
-    // so genau.
-    // Jeder Schleifendurchlauf muss allerdings die gleiche Anzahl von Zyklen bentigen. Das ist bei
-    // if Verzweigungen u. U. kritisch. Auerdem muss bei einer Programmnderung der Wert fr
-    // WAIT_US_PER_LOOP neu eingemessen werden.
-    DELAY_US(WAIT_US_PER_LOOP);
-
+#endif
   }  // while (1) 
 }
 
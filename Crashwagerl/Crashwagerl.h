@@ -3,8 +3,10 @@
 CRASHWAGERL.H
 
 Autor: Michael Schletz, 22. November 2016
-Desc:  Headerdatei mit den Definitionen der Pins und inline Hilfsfunktionen fr das Lesen des AD
-       Wertes und die base64 Codierung.
+Desc:  Headerdatei mit der Konfiguration, den Definitionen der Pins und inline Hilfsfunktionen fr
+       die base64 Codierung. Die Datei verwendet keine AVR Header, die Zugriffe auf die Hardware
+       sind in den Dateien, die Hal.h einbindet. So kann die Codierung auch am PC bersetzt
+       werden (s. Host/HostBackend.h).
 *************************************************************************************************
 */
 
@@ -12,165 +14,236 @@ Desc:  Headerdatei mit den Definitionen der Pins und inline Hilfsfunktionen f
 #define CRASHWAGERL_H_
 
 /* KONFIGURATION ******************************************************************************** */
-#define OSCILLATOR_CAL    88   // Wert fr die Oszillatorkalibrierung fr 7.3728 MHz
+#define OSCILLATOR_CAL    88   // Wert fr die Oszillatorkalibrierung fr 7.3728 MHz, wird nur
+                               // verwendet, solange im EEPROM noch kein Wert gespeichert ist.
+#define OSCCAL_REF_PIN    PB2  // Pin fr das Referenzsignal der Kalibrierung beim Einschalten
+#define OSCCAL_REF_HZ     1000 // Frequenz des Referenzsignals
+#define OSCCAL_REF_PERIODS 10  // Anzahl der Perioden pro Messung
 #define MILLISEC_PIN      PB0  // Pin, wo der ms Takt ausgegeben wird.
 #define UART_TIMER_CYCLES 16   // 460 800 Baud bei 7.3728 MHz Takt (Prescale 1)
-#define WAIT_US_PER_LOOP  123  // Anzahl der Mikrosekunden, die nach der bertragung und vor der
-                               // nchsten Messung gewartet wird. Muss mit dem Oszi und dem 
-                               // MILLISEC_PIN ermittelt werden.
+#define UART_TX_BUFFER_SIZE 32 // Sendepuffer in Bytes (2er Potenz), fasst 2 Nachrichten.
+#define FRAME_FORMAT      FRAME_FORMAT_BASE64 // FRAME_FORMAT_BASE64: 12 Zeichen + CR LF (Text)
+                                              // FRAME_FORMAT_BINARY: 7 Bytes mit CRC (s. 
+                                              // FrameFormat.h), erlaubt die doppelte Rate.
+                                              // FRAME_FORMAT_DELTA: Keyframes und Deltas
+                                              // mit 1 - 4 Bytes fr hohe Raten.
+#define SAMPLE_RATE_HZ    1000 // Messungen pro Sekunde. Wird vom Timer 1 erzeugt, bei 1000 ist
+                               // der Timecode in ms.
+#define ADC_PRESCALER     64   // 115.2 kHz ADC Takt. Fr mehr als 2 kHz muss 32 verwendet werden
+                               // (230.4 kHz, etwas ungenauer als die empfohlenen 50 - 200 kHz).
+#define ADC_OVERSAMPLING_LOG4 0 // n: 4^n Wandlungen pro Kanal und Messung werden summiert, das
+                               // ergibt 10 + n Bit (max. 12 im base64 Format, sonst gemittelt
+                               // auf 10 Bit). Die Wandlungen brauchen ADC_SEQUENCE_TICKS ADC Takte
+                               // (AdcScheduler.h), bei n = 2 also 685. Mit ADC_PRESCALER 64 ist
+                               // SAMPLE_RATE_HZ dann hchstens 167 Hz (159 mit REF_TRACKING 1).
+#define CH1_DIVIDER       1    // Kanalplan: Kanal 1 (PB2) bei jeder n-ten Messung wandeln und
+#define CH2_DIVIDER       1    // senden (1, 2 oder 4), 0: aus. Mindestens ein Kanal muss 1
+#define CH3_DIVIDER       1    // haben, SAMPLE_RATE_HZ ist die Rate dieses Kanals. Nur mit
+                               // FRAME_FORMAT_BINARY, z. B. nur Kanal 1 mit 3 kHz.
+#define REF_TRACKING      1    // 1: Die 1.1 V Referenz in jedem Intervall nach den Kanlen
+                               // wandeln und den Wert alle 16 Messungen aktualisieren (s.
+                               // AdcScheduler.h). 0: Nur beim Einschalten messen, ntig bei
+                               // hohen SAMPLE_RATE_HZ ohne freie Zeit im Intervall.
+#define REF_SETTLE_US     100  // Zeit zwischen Umschalten auf die Referenz und Wandlung (max.
+                               // Anlaufzeit der Bandgap lt. Datenblatt 70 us).
+
+#define BURST_MODE        0    // 1: Messungen in einen Ringpuffer schreiben und erst nach dem
+                               // Trigger senden (s. BurstCapture.h).
+#define BURST_SAMPLES     40   // Gre des Ringpuffers (3 Bytes pro Messung).
+#define BURST_POST_SAMPLES 30  // Messungen, die nach dem Trigger aufgezeichnet werden.
+#define BURST_TRIGGER_CHANNEL 1  // Kanal fr den Trigger (1 - 3).
+#define BURST_TRIGGER_LEVEL 512  // ADC Wert, bei dessen berschreiten getriggert wird.
+#define BURST_TRIGGER_RISING 1   // 1: steigende Flanke, 0: fallende Flanke
+
+#define PROFILE_STAGES    0    // 1: Markierungen fr die Laufzeitmessung im Simulator in GPIOR0
+                               // und GPIOR1 schreiben (s. Profiling.h).
 
 #define F_CPU 7372800ul        // Fuse CKDIV8 deaktiviert werden!
 /* ********************************************************************************************** */
 
-#include <stdlib.h>
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/sleep.h>
+#include "FrameFormat.h"
+
+// Kanalplan. Die Teiler sind 2er Potenzen bis 4, daher wiederholt sich die Folge der gewandelten
+// Kanle nach CHANNEL_PLAN_CYCLE Messungen.
+#define CHANNEL_VALID_DIVIDER(d) ((d) == 0 || (d) == 1 || (d) == 2 || (d) == 4)
+#if !CHANNEL_VALID_DIVIDER(CH1_DIVIDER) || !CHANNEL_VALID_DIVIDER(CH2_DIVIDER) || \
+    !CHANNEL_VALID_DIVIDER(CH3_DIVIDER)
+#error "CH1_DIVIDER bis CH3_DIVIDER mssen 0, 1, 2 oder 4 sein"
+#endif
+#if CH1_DIVIDER != 1 && CH2_DIVIDER != 1 && CH3_DIVIDER != 1
+#error "Mindestens ein Kanal muss bei jeder Messung gewandelt werden (CHx_DIVIDER 1)"
+#endif
+#define CHANNEL_PLAN      (CH1_DIVIDER != 1 || CH2_DIVIDER != 1 || CH3_DIVIDER != 1)
+#define CHANNEL_PLAN_CYCLE 4
+#define CHANNEL_PLAN_CODE ((PLAN_CODE(CH1_DIVIDER) << 4) | (PLAN_CODE(CH2_DIVIDER) << 2) | \
+                           PLAN_CODE(CH3_DIVIDER))
+#define ADC_ACTIVE_CHANNELS ((CH1_DIVIDER != 0) + (CH2_DIVIDER != 0) + (CH3_DIVIDER != 0))
+// Wandlungen pro Kanal in CHANNEL_PLAN_CYCLE Messungen
+#define CHANNEL_PLAN_SAMPLES(d) ((d) ? CHANNEL_PLAN_CYCLE / (d) : 0)
+#if CHANNEL_PLAN && (FRAME_FORMAT != FRAME_FORMAT_BINARY || BURST_MODE)
+#error "Ein Kanalplan (CHx_DIVIDER ungleich 1) geht nur mit FRAME_FORMAT_BINARY ohne BURST_MODE"
+#endif
+
+// MESSAGE_LENGTH ist die grte Nachricht. Fr die Prfung der bertragungszeit werden
+// hchstens MESSAGE_BUDGET_BYTES in MESSAGE_BUDGET_SAMPLES Messungen gesendet.
+#if FRAME_FORMAT == FRAME_FORMAT_BINARY && CHANNEL_PLAN
+// Eine Nachricht hat 4 Bytes + 1 Byte pro Kanal (s. FrameFormat.h).
+#define MESSAGE_LENGTH    BINARY_FRAME_LENGTH
+#define MESSAGE_BUDGET_SAMPLES CHANNEL_PLAN_CYCLE
+#define MESSAGE_BUDGET_BYTES   (4 * CHANNEL_PLAN_CYCLE + CHANNEL_PLAN_SAMPLES(CH1_DIVIDER) + \
+                                CHANNEL_PLAN_SAMPLES(CH2_DIVIDER) + \
+                                CHANNEL_PLAN_SAMPLES(CH3_DIVIDER))
+#elif FRAME_FORMAT == FRAME_FORMAT_BINARY
+#define MESSAGE_LENGTH    BINARY_FRAME_LENGTH
+#define MESSAGE_BUDGET_SAMPLES 1
+#define MESSAGE_BUDGET_BYTES   MESSAGE_LENGTH
+#elif FRAME_FORMAT == FRAME_FORMAT_DELTA
+#define MESSAGE_LENGTH    DELTA_KEYFRAME_LENGTH
+#define MESSAGE_BUDGET_SAMPLES DELTA_KEYFRAME_INTERVAL
+#define MESSAGE_BUDGET_BYTES   (DELTA_KEYFRAME_LENGTH + \
+                                (DELTA_KEYFRAME_INTERVAL - 1) * DELTA_MAX_FRAME_LENGTH)
+#else
+#define MESSAGE_LENGTH    BASE64_FRAME_LENGTH   // Bytes pro Nachricht inkl. CR LF
+#define MESSAGE_BUDGET_SAMPLES 1
+#define MESSAGE_BUDGET_BYTES   MESSAGE_LENGTH
+#endif
+
+#if   ADC_PRESCALER == 8
+#define ADC_PRESCALER_LOG2 3
+#elif ADC_PRESCALER == 16
+#define ADC_PRESCALER_LOG2 4
+#elif ADC_PRESCALER == 32
+#define ADC_PRESCALER_LOG2 5
+#elif ADC_PRESCALER == 64
+#define ADC_PRESCALER_LOG2 6
+#elif ADC_PRESCALER == 128
+#define ADC_PRESCALER_LOG2 7
+#else
+#error "ADC_PRESCALER muss 8, 16, 32, 64 oder 128 sein"
+#endif
 
-#include "UartLibrary.h"
+// Auflsung der Messwerte. Das base64 Format hat 12 Bit pro Kanal, die anderen Formate und der
+// Burstpuffer nur 10 Bit. Die Summe der Wandlungen wird um ADC_RESULT_SHIFT nach rechts geschoben.
+#if ADC_OVERSAMPLING_LOG4 > 3
+#error "ADC_OVERSAMPLING_LOG4 darf hchstens 3 sein, sonst luft die 16 Bit Summe ber"
+#endif
+#if FRAME_FORMAT == FRAME_FORMAT_BASE64 && !BURST_MODE
+#define ADC_MAX_RESULT_BITS 12
+#else
+#define ADC_MAX_RESULT_BITS 10
+#endif
+#if 10 + ADC_OVERSAMPLING_LOG4 > ADC_MAX_RESULT_BITS
+#define ADC_RESULT_BITS   ADC_MAX_RESULT_BITS
+#else
+#define ADC_RESULT_BITS   (10 + ADC_OVERSAMPLING_LOG4)
+#endif
+#define ADC_RESULT_SHIFT  (10 + 2 * ADC_OVERSAMPLING_LOG4 - ADC_RESULT_BITS)
+#define ADC_RESULT_ROUND  ((1 << ADC_RESULT_SHIFT) >> 1)   // Halbes LSB, die Summe wird gerundet.
+
+#if BURST_MODE && FRAME_FORMAT == FRAME_FORMAT_DELTA
+#error "BURST_MODE kann nicht mit FRAME_FORMAT_DELTA verwendet werden"
+#endif
+
+// Im BURST_MODE wird erst nach der Aufzeichnung gesendet, die bertragungszeit spielt also keine 
+// Rolle.
+#if !BURST_MODE
+// Ein Byte braucht mit Start- und 2 Stoppbits 11 Bitzeiten. Die Nachricht muss gesendet sein,
+// bevor die nchste fertig ist.
+#if SAMPLE_RATE_HZ * MESSAGE_BUDGET_BYTES * 11ul * UART_TIMER_CYCLES > \
+    F_CPU * MESSAGE_BUDGET_SAMPLES
+#error "SAMPLE_RATE_HZ ist zu gro, die Nachricht kann nicht in einem Intervall gesendet werden"
+#endif
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#endif
 
 typedef enum {STATE_IDLE, STATE_MS_COMPLETE} STATES;
 typedef enum {ADC_PB5, ADC_PB2, ADC_PB4, ADC_PB3, ADC_NA1, ADC_NA2, ADC_NA3, ADC_NA4, 
               ADC_NA5, ADC_NA6, ADC_NA7, ADC_NA8, ADC_1V1REF, ADC_SAME_CHANNEL } ADC_CHANNELS;
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
-* Wartet przise die angegebene Anzahl von Mikrosekunden. Der maximale Wert betrgt bei 16 MHz
-* 17 179, damit die Berechnung nicht berluft. Der minimale Wert darf nicht unter 16 Zyklen 
-* entsprechen, also 16 us bei 1 MHz oder 1 us bei 16 MHz.
-* Erklrung der Berechnung: / 4 weil pro Schleife 4 Zyklen verwendet werden.
-*                           - 3 weil der Overhead 12 Zyklen, also 3 Durchlufen entspricht
-*                           + 500000 damit nicht abgeschnitten, sondern gerundet wird
-* Das ergibt (F_CPU / 4 * val + 500000) / 1000000 - 3
-* Damit die Berechnung nicht berluft, wurde Zhler und Nenner noch durch 16 gekrzt.
-* @param val: Ein Wert von 16 / CPU Clock (in MHz) bis zu 1073 us, der gewartet werden soll.
-* @return void
-*/
-////////////////////////////////////////////////////////////////////////////////////////////////////
-#define DELAY_US(val) __asm__ volatile (                                                           \
-  "push R24 \n\t"                         /* Register am Stack sichern */                          \
-  "push R25 \n\t"                         /* (2 Cycles) */                                         \
-  "ldi R24,%[counterLo] \n\t"                                                                      \
-  "ldi R25,%[counterHi] \n\t"                                                                      \
-  "1: sbiw R24,1" "\n\t"     /* Subtract Immediate from Word, 2 Cycles  */                         \
-  "brne 1b \n\t"             /* Branch if Not Equal, 2 Cycles wenn true */                         \
-  "nop \n\t"                 /* Um den fehlenden Sprung auszugleichen (brne hat nur 1 Zyklus */    \
-                             /* fr false, somit braucht jeder Durchlauf 4 Zyklen) */              \
-  "pop R25 \n\t"                                                                                   \
-  "pop R24 \n\t"                                                                                   \
-  "nop \n\t"                 /* Damit 12 Zyklen (durch 4 teilbar) overload entstehen */            \
-  "nop \n\t"                 /* (das entspricht 3 Durchlaeufen */                                  \
-  :                                                                                                \
-  : [counterHi] "M" (((F_CPU / 64ul * val + 31250ul) / 62500ul - 3ul) >> 8),                      \
-    [counterLo] "M" (((F_CPU / 64ul * val + 31250ul) / 62500ul - 3ul) & 0xFF)                     \
-)
+// Dreht die Bits einer Konstanten schon beim bersetzen um (wie reverseByte).
+#define REVERSE_BYTE(x) ((((x) & 0x01) << 7) | (((x) & 0x02) << 5) | (((x) & 0x04) << 3) | \
+                         (((x) & 0x08) << 1) | (((x) & 0x10) >> 1) | (((x) & 0x20) >> 3) | \
+                         (((x) & 0x40) >> 5) | (((x) & 0x80) >> 7))
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
-* Initialisiert den AD Converter fr eine single-ended Messung. Der Prescaler stellt einen Wert fr
-* den ADC Clock auf einen Wert von 50 - 200 kHz ein. Der AD Conversion Comlete Interrupt wird 
-* aktiviert, damit im Sleep Modus SLEEP_MODE_ADC gemessen werden kann.
-* @return void
-*/
-////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline void initAdc()
+// Zeichen der base64 Codierung, schon fr das USI Schieberegister umgedreht (s. UartLibrary.h).
+// Liegt im Flash, damit die 64 Bytes kein RAM belegen.
+static const uint8_t base64ReversedTable[64] PROGMEM =
 {
-  ADCSRA = (1 << ADEN) |      // AD Converter aktivieren.
-           (0b110 << ADPS0) | // Prescaler 64, ergibt 115.2 kHz fr den AD Converter (s. Doku, S125)
-           (1 << ADIE);       // AD Conversion Complete Interrupt aktivieren.
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
-* Liest vom AD Converter. Dabei wird die CPU in den ADC Noise Reduction Sleep Mode geschickt. 
-* Der AD Complete Interrupt weckt sie wieder auf und es kann das Ergebnis aus dem ADC Register
-* gelesen werden. Dieser Vorgang wird mehrmals (je nach dem Wert von NUMBER_OF_MEASUREMENTS)
-* durchgefhrt, um das Ergebnis zu mitteln.
-* Eine Wandlung bentigt 13 Zyklen, wobei 1 Zyklus = CPU-Takt / Prescaler, also rd. 115 kHz ist.
-* @return Gelesener AD Wert (0 - 1023)
-*/
-////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline uint16_t readAdcValue(ADC_CHANNELS channel)
-{
-  if (channel != ADC_SAME_CHANNEL)
-  {
-    ADMUX = (0b000 << REFS0) | (channel << MUX0); // Vom angegebenen Eingang mit Vcc als 
-                                                  // Referenzspannung lesen.
-  }
-  if (channel == ADC_1V1REF)
-  {
-    DELAY_US(5000);               // 5 ms warten (1ms Mindeszeit lt. Datenblatt).
-  }
-  set_sleep_mode(SLEEP_MODE_ADC); // ADC Noise Reduction Sleep Mode einstellen.
-  sleep_mode();                   // Sleepmode starten. 
-  while (ADCSRA & (1 << ADSC));   // Warten, solange der AD Wandler noch arbeitet. Das 
-                                  // sollte jedoch nicht auftreten. Es kommt nur vor, 
-                                  // wenn ein anderer Interrupt die CPU vor dem Ende der 
-                                  // Konvertierung aufweckt.
-  return ADC;                    // Ergebnis auslesen und zurckliefern.
-}
+  REVERSE_BYTE('A'), REVERSE_BYTE('B'), REVERSE_BYTE('C'), REVERSE_BYTE('D'), REVERSE_BYTE('E'),
+  REVERSE_BYTE('F'), REVERSE_BYTE('G'), REVERSE_BYTE('H'), REVERSE_BYTE('I'), REVERSE_BYTE('J'),
+  REVERSE_BYTE('K'), REVERSE_BYTE('L'), REVERSE_BYTE('M'), REVERSE_BYTE('N'), REVERSE_BYTE('O'),
+  REVERSE_BYTE('P'), REVERSE_BYTE('Q'), REVERSE_BYTE('R'), REVERSE_BYTE('S'), REVERSE_BYTE('T'),
+  REVERSE_BYTE('U'), REVERSE_BYTE('V'), REVERSE_BYTE('W'), REVERSE_BYTE('X'), REVERSE_BYTE('Y'),
+  REVERSE_BYTE('Z'), REVERSE_BYTE('a'), REVERSE_BYTE('b'), REVERSE_BYTE('c'), REVERSE_BYTE('d'),
+  REVERSE_BYTE('e'), REVERSE_BYTE('f'), REVERSE_BYTE('g'), REVERSE_BYTE('h'), REVERSE_BYTE('i'),
+  REVERSE_BYTE('j'), REVERSE_BYTE('k'), REVERSE_BYTE('l'), REVERSE_BYTE('m'), REVERSE_BYTE('n'),
+  REVERSE_BYTE('o'), REVERSE_BYTE('p'), REVERSE_BYTE('q'), REVERSE_BYTE('r'), REVERSE_BYTE('s'),
+  REVERSE_BYTE('t'), REVERSE_BYTE('u'), REVERSE_BYTE('v'), REVERSE_BYTE('w'), REVERSE_BYTE('x'),
+  REVERSE_BYTE('y'), REVERSE_BYTE('z'), REVERSE_BYTE('0'), REVERSE_BYTE('1'), REVERSE_BYTE('2'),
+  REVERSE_BYTE('3'), REVERSE_BYTE('4'), REVERSE_BYTE('5'), REVERSE_BYTE('6'), REVERSE_BYTE('7'),
+  REVERSE_BYTE('8'), REVERSE_BYTE('9'), REVERSE_BYTE('+'), REVERSE_BYTE('/')
+};
 
+// Umgedrehtes base64 Zeichen fr die unteren 6 Bit von val.
+#define BASE64_REVERSED_CHAR(val) pgm_read_byte(&base64ReversedTable[(uint8_t)(val) & 0x3F])
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
-* Codiert eine bergebene 32bit Variable als ASCII base64 String. Dies Codierung ist allerdings
-* keine standardgeme base64 Codierung, da hier nicht auf 3 Bytes aufgefllt wird. Es wird im
-* Prinzip ins 64er System konvertiert und die Zeichentabelle der base64 Codierung verwendet.
-* @param val: Der zu codierende binre Wert.
-* @param bufferPtr: Pointer auf den Puffer, der den String speichern soll.
-* @param len: Lnge des base64 codierten Strings. Ist die Lnge kleiner als ein 32bit Wert haben
-*             kann (6 Zeichen), werden die niederwertigsten Bits genommen. Es knnen pro Zeichen
-*             6 Bits codiert werden (2^6 = 64)
+* Erstellt eine base64 Nachricht (gleicher Inhalt wie uint32ToBase64 und uint16ToBase64 in
+* Host/encodebench.c) mit schon umgedrehten Bytes fr uartSendReversedBytes. Jedes Zeichen kommt
+* aus base64ReversedTable, es gibt keine Verzweigung und keine Schleife. Damit braucht die
+* Codierung fr jeden Timecode und jeden Messwert gleich viele Zyklen.
+* @param framePtr: Puffer mit BASE64_FRAME_LENGTH Bytes.
+* @param timecode: Timecode der Nachricht (die unteren 24 Bit werden verwendet).
+* @param valuesPtr: Ref, Ch1, Ch2, Ch3 (je 12 Bit).
 * @return void
 */
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline void uint32ToBase64(uint32_t val, char *bufferPtr, uint8_t len)
+static inline void encodeBase64Frame(uint8_t *framePtr, uint32_t timecode,
+                                     const uint16_t *valuesPtr)
 {
-  uint8_t byteToEncode;
-
-  bufferPtr += len;
-  while (len--)
-  {
-    --bufferPtr;
-    byteToEncode = val & 0b111111;
-    val >>= 6;
-    if (byteToEncode < 26)       *bufferPtr = 'A'+byteToEncode;
-    else if (byteToEncode < 52)  *bufferPtr = 'a'+(byteToEncode-26);
-    else if (byteToEncode < 62)  *bufferPtr = '0'+(byteToEncode-52);
-    else if (byteToEncode == 62) *bufferPtr = '+';
-    else if (byteToEncode == 63) *bufferPtr = '/';
-  }
+  framePtr[0] = BASE64_REVERSED_CHAR(timecode >> 18);
+  framePtr[1] = BASE64_REVERSED_CHAR(timecode >> 12);
+  framePtr[2] = BASE64_REVERSED_CHAR(timecode >> 6);
+  framePtr[3] = BASE64_REVERSED_CHAR(timecode);
+  framePtr[4] = BASE64_REVERSED_CHAR(valuesPtr[0] >> 6);
+  framePtr[5] = BASE64_REVERSED_CHAR(valuesPtr[0]);
+  framePtr[6] = BASE64_REVERSED_CHAR(valuesPtr[1] >> 6);
+  framePtr[7] = BASE64_REVERSED_CHAR(valuesPtr[1]);
+  framePtr[8] = BASE64_REVERSED_CHAR(valuesPtr[2] >> 6);
+  framePtr[9] = BASE64_REVERSED_CHAR(valuesPtr[2]);
+  framePtr[10] = BASE64_REVERSED_CHAR(valuesPtr[3] >> 6);
+  framePtr[11] = BASE64_REVERSED_CHAR(valuesPtr[3]);
+  framePtr[12] = REVERSE_BYTE('\r');
+  framePtr[13] = REVERSE_BYTE('\n');
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
-* Codiert eine bergebene 16bit Variable als ASCII base64 String. Dies Codierung ist allerdings
-* keine standardgeme base64 Codierung, da hier nicht auf 3 Bytes aufgefllt wird. Es wird im
-* Prinzip ins 64er System konvertiert und die Zeichentabelle der base64 Codierung verwendet.
-* @param val: Der zu codierende binre Wert.
-* @param bufferPtr: Pointer auf den Puffer, der den String speichern soll.
-* @param len: Lnge des base64 codierten Strings. Ist die Lnge kleiner als ein 16bit Wert haben
-*             kann (3 Zeichen), werden die niederwertigsten Bits genommen. Es knnen pro Zeichen
-*             6 Bits codiert werden (2^6 = 64)
-* @return void
+* Dreht alle Bits eines Bytes in der Reihenfolge um, macht also aus 10001011 -> 11010001. Das ist
+* fr die bertragung ber das USI Schieberegister ntig (s. UartLibrary.h).
+* @param val: Bytewert
+* @return Umgedrehtes Byte
 */
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline void uint16ToBase64(uint16_t val, char *buffer, uint8_t len)
+static inline uint8_t reverseByte (uint8_t x)
 {
-  uint8_t byteToEncode;
-
-  buffer += len;
-  while (len--)
-  {
-    --buffer;
-    byteToEncode = val & 0b111111;
-    val >>= 6;
-    if (byteToEncode < 26)       *buffer = 'A'+byteToEncode;
-    else if (byteToEncode < 52)  *buffer = 'a'+(byteToEncode-26);
-    else if (byteToEncode < 62)  *buffer = '0'+(byteToEncode-52);
-    else if (byteToEncode == 62) *buffer = '+';
-    else if (byteToEncode == 63) *buffer = '/';
-  }
+  x = ((x & 0x55) << 1) | ((x & 0xaa) >> 1);
+  x = ((x & 0x33) << 2) | ((x & 0xcc) >> 2);
+#ifdef __AVR__
+  __asm__ volatile ("swap %0" : "=r" (x) : "0" (x)); /* swap nibbles. */
+#else
+  x = (uint8_t)((x << 4) | (x >> 4));
+#endif
+  return x;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,387 @@
+/*
+****************************************************************************************************
+FRAMEFORMAT.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Definition des binren Nachrichtenformats. Die Datei verwendet keine AVR Header, damit sie
+       auch vom Empfnger (Verzeichnis Host) eingebunden werden kann.
+
+       Eine binre Nachricht hat 7 Bytes statt der 14 Bytes der base64 Nachricht:
+         Byte  0: Sync (0xA5)
+         Byte  1: Bit 0..7 des Timecodes
+         Byte  2: Ch1 Bit 9..2
+         Byte  3: Ch1 Bit 1..0, Ch2 Bit 9..4
+         Byte  4: Ch2 Bit 3..0, Ch3 Bit 9..6
+         Byte  5: Ch3 Bit 5..0, 2 Bits des Slow Words
+         Byte  6: CRC-8 (Polynom 0x07, Startwert 0) ber Byte 1..5
+       Das Slow Word hat 32 Bit und wird in 16 Nachrichten mit je 2 Bit bertragen (MSB zuerst).
+       Die Position ergibt sich aus den unteren 4 Bit des Timecodes. Inhalt:
+         Bit 31..16: Bit 8..23 des Timecodes
+         Bit 15..6:  Wert der internen 1.1V Referenzspannung
+         Bit 5..0:   Kanalplan, je 2 Bit fr Ch1, Ch2, Ch3 (0: jede, 1: jede 2., 2: jede 4.
+                     Messung, 3: aus). Ohne Kanalplan 0.
+       Der Empfnger sucht das Sync Byte und prft den CRC. Stimmt er nicht, wird ab dem nchsten
+       Byte wieder nach dem Sync Byte gesucht.
+       Mit einem Kanalplan enthlt eine Nachricht nur die Kanle, die bei dieser Messung gewandelt
+       wurden. Das Sync Byte ist dann 0xB0 | Maske (Bit 0 = Ch1), danach folgen der Timecode, die
+       Werte mit je 10 Bit und die 2 Bits des Slow Words wie oben, mit 0 Bits auf ganze Bytes
+       aufgefllt, und der CRC. Mit 1 oder 2 Kanlen hat die Nachricht 5 bzw. 6 Bytes. Mit allen
+       3 Kanlen bleibt es bei 0xA5 und 7 Bytes.
+       Vor der ersten Nachricht (im BURST_MODE vor jedem Burst) steht eine Prambel mit 6 Bytes:
+         Byte  0:    Sync (0xB7, 0xB0 | alle Kanle)
+         Byte  1..4: Slow Word der folgenden Nachricht (MSB zuerst)
+         Byte  5:    CRC-8 ber Byte 1..4
+       Damit kennt der Empfnger Timecode, Referenz und Kanalplan ab der ersten Nachricht und muss
+       nicht 16 Nachrichten auf das Slow Word warten.
+
+       Im Deltaformat (FRAME_FORMAT_DELTA) wird alle DELTA_KEYFRAME_INTERVAL Messungen (wenn die
+       unteren Bits des Timecodes 0 sind) ein Keyframe mit 11 Bytes gesendet:
+         Byte  0:    Sync (0xA6)
+         Byte  1..3: Timecode Bit 23..0
+         Byte  4..8: Ref, Ch1, Ch2, Ch3 mit je 10 Bit gepackt (MSB zuerst)
+         Byte  9:    CRC-8 ber alle Deltaframes seit dem letzten Keyframe
+         Byte 10:    CRC-8 ber Byte 1..9
+       Dazwischen kommt pro Messung ein Deltaframe mit 1 - 4 Bytes. Die oberen 2 Bit des ersten
+       Bytes geben die Breite an, danach folgen die 3 Werte MSB zuerst:
+         00: 3 x 2 Bit Differenz zur vorigen Messung (-2..1)      1 Byte
+         01: 3 x 4 Bit Differenz (-8..7)                          2 Bytes
+         10: 3 x 6 Bit Differenz (-32..31)                        3 Bytes
+         11: 3 x 10 Bit Absolutwert                               4 Bytes
+       Der Timecode eines Deltaframes ist um 1 grer als der der vorigen Nachricht. Da der
+       Empfnger wei, wann der nchste Keyframe kommt, kann er Keyframes und Deltaframes
+       unterscheiden. Stimmt der Delta CRC im Keyframe nicht, werden alle Werte seit dem letzten
+       Keyframe verworfen.
+****************************************************************************************************
+*/
+
+#ifndef FRAMEFORMAT_H_
+#define FRAMEFORMAT_H_
+
+#include <stdint.h>
+
+#define FRAME_FORMAT_BASE64  0        // 12 Zeichen base64 + CR LF
+#define FRAME_FORMAT_BINARY  1        // 7 Bytes mit Sync und CRC-8
+#define FRAME_FORMAT_DELTA   2        // Keyframes mit 11 Bytes, dazwischen Deltaframes 1 - 4 Bytes
+
+#define BASE64_FRAME_LENGTH  14
+#define BINARY_FRAME_LENGTH  7
+#define BINARY_FRAME_SYNC    0xA5
+#define BINARY_SLOW_FRAMES   16       // Anzahl der Nachrichten fr ein Slow Word.
+#define BINARY_PLAN_SYNC     0xB0     // | Maske der Kanle in der Nachricht
+#define CHANNEL_ALL          0b111    // Maske mit allen 3 Kanlen
+#define BINARY_PREAMBLE_SYNC (BINARY_PLAN_SYNC | CHANNEL_ALL)
+#define BINARY_PREAMBLE_LENGTH 6
+#define PLAN_CODE(divider)   ((divider) == 1 ? 0 : (divider) == 2 ? 1 : (divider) == 4 ? 2 : 3)
+
+#define DELTA_KEYFRAME_INTERVAL  16   // 2er Potenz, Sender und Empfnger mssen gleich sein.
+#define DELTA_KEYFRAME_LENGTH    11
+#define DELTA_KEYFRAME_SYNC      0xA6
+#define DELTA_MAX_FRAME_LENGTH   4
+
+// Zustand des Deltaencoders zwischen 2 Messungen.
+typedef struct
+{
+  uint16_t lastValues[3];      // Ch1..Ch3 der vorigen Messung
+  uint8_t segmentCrc;          // CRC-8 ber die Deltaframes seit dem letzten Keyframe
+} DELTA_ENCODER;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Berechnet den CRC-8 mit dem Polynom x^8 + x^2 + x + 1 (0x07). Entspricht _crc8_ccitt_update aus
+* util/crc16.h der avr-libc, ist aber auch am PC verwendbar.
+* @param crc: Bisheriger CRC Wert (Startwert 0).
+* @param data: Nchstes Byte.
+* @return Neuer CRC Wert.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t crc8Update(uint8_t crc, uint8_t data)
+{
+  uint8_t count;
+
+  crc ^= data;
+  for (count = 8; count; count--)
+  {
+    if (crc & 0x80) crc = (crc << 1) ^ 0x07;
+    else            crc <<= 1;
+  }
+  return crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert die 2 Bits des Slow Words, die in der Nachricht mit dem bergebenen Timecode gesendet
+* werden. Der Referenzwert darf sich innerhalb von 16 Nachrichten nicht ndern, sonst bekommt der
+* Empfnger einen gemischten Wert.
+* @param timecode: Timecode der Nachricht.
+* @param refValue: Wert der internen 1.1V Referenzspannung (10 Bit).
+* @param planCode: Kanalplan (6 Bit, s. oben).
+* @return Bits 1..0 mit dem Teil des Slow Words.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t binarySlowBits(uint32_t timecode, uint16_t refValue, uint8_t planCode)
+{
+  uint8_t position = (uint8_t)timecode & (BINARY_SLOW_FRAMES - 1);
+  uint16_t word;
+
+  if (position < 8)
+  {
+    word = (uint16_t)(timecode >> 8);     // Bit 31..16 des Slow Words
+  }
+  else
+  {
+    word = (refValue << 6) | planCode;    // Bit 15..0 des Slow Words
+    position -= 8;
+  }
+  return (word >> (14 - 2 * position)) & 0b11;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erstellt eine binre Nachricht im oben beschriebenen Format.
+* @param framePtr: Puffer mit BINARY_FRAME_LENGTH Bytes.
+* @param timecode: Timecode der Nachricht (die unteren 24 Bit werden verwendet).
+* @param refValue: Wert der internen 1.1V Referenzspannung.
+* @param ch1, ch2, ch3: Messwerte (10 Bit).
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void encodeBinaryFrame(uint8_t *framePtr, uint32_t timecode, uint16_t refValue,
+                                     uint16_t ch1, uint16_t ch2, uint16_t ch3)
+{
+  uint8_t crc = 0;
+  uint8_t count;
+
+  framePtr[0] = BINARY_FRAME_SYNC;
+  framePtr[1] = (uint8_t)timecode;
+  framePtr[2] = (uint8_t)(ch1 >> 2);
+  framePtr[3] = (uint8_t)(ch1 << 6) | (uint8_t)((ch2 >> 4) & 0x3F);
+  framePtr[4] = (uint8_t)(ch2 << 4) | (uint8_t)((ch3 >> 6) & 0x0F);
+  framePtr[5] = (uint8_t)(ch3 << 2) | binarySlowBits(timecode, refValue, 0);
+  for (count = 1; count < BINARY_FRAME_LENGTH - 1; count++)
+  {
+    crc = crc8Update(crc, framePtr[count]);
+  }
+  framePtr[BINARY_FRAME_LENGTH - 1] = crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erstellt eine binre Nachricht mit Kanalplan, die nur die Kanle aus channels enthlt. Mit
+* allen 3 Kanlen und planCode 0 ist sie gleich wie bei encodeBinaryFrame.
+* @param framePtr: Puffer mit BINARY_FRAME_LENGTH Bytes.
+* @param timecode: Timecode der Nachricht.
+* @param valuesPtr: Ref, Ch1, Ch2, Ch3 (je 10 Bit), nicht enthaltene Kanle werden ignoriert.
+* @param channels: Maske der Kanle (Bit 0 = Ch1), nicht 0.
+* @param planCode: Kanalplan fr das Slow Word.
+* @return Anzahl der Bytes in framePtr.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t encodeBinaryPlanFrame(uint8_t *framePtr, uint32_t timecode,
+                                            const uint16_t *valuesPtr, uint8_t channels,
+                                            uint8_t planCode)
+{
+  uint32_t bits = 0;
+  uint8_t width = 2;
+  uint8_t crc = 0;
+  uint8_t len;
+  uint8_t count;
+
+  // Die Werte werden rechtsbndig gesammelt und dann linksbndig geschoben.
+  for (count = 0; count < 3; count++)
+  {
+    if (channels & (1 << count))
+    {
+      bits = (bits << 10) | (valuesPtr[count+1] & 0x3FF);
+      width += 10;
+    }
+  }
+  bits = (bits << 2) | binarySlowBits(timecode, valuesPtr[0], planCode);
+  bits <<= 32 - width;
+  len = (width + 7) >> 3;
+
+  framePtr[0] = channels == CHANNEL_ALL ? BINARY_FRAME_SYNC : (BINARY_PLAN_SYNC | channels);
+  framePtr[1] = (uint8_t)timecode;
+  for (count = 0; count < len; count++)
+  {
+    framePtr[2+count] = (uint8_t)(bits >> 24);
+    bits <<= 8;
+  }
+  len += 2;
+  for (count = 1; count < len; count++)
+  {
+    crc = crc8Update(crc, framePtr[count]);
+  }
+  framePtr[len] = crc;
+  return len + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schreibt die Prambel mit dem ganzen Slow Word (s. oben) in den Puffer.
+* @param framePtr: Puffer mit BINARY_PREAMBLE_LENGTH Bytes.
+* @param timecode: Timecode der folgenden Nachricht.
+* @param refValue: Wert der internen 1.1V Referenzspannung (10 Bit).
+* @param planCode: Kanalplan (6 Bit, s. oben).
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void encodeBinaryPreamble(uint8_t *framePtr, uint32_t timecode, uint16_t refValue,
+                                        uint8_t planCode)
+{
+  uint32_t word = ((timecode >> 8) << 16) | ((uint32_t)refValue << 6) | planCode;
+  uint8_t crc = 0;
+  uint8_t count;
+
+  framePtr[0] = BINARY_PREAMBLE_SYNC;
+  for (count = 1; count < BINARY_PREAMBLE_LENGTH - 1; count++)
+  {
+    framePtr[count] = (uint8_t)(word >> 24);
+    word <<= 8;
+    crc = crc8Update(crc, framePtr[count]);
+  }
+  framePtr[BINARY_PREAMBLE_LENGTH - 1] = crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert die Lnge einer binren Nachricht anhand des Sync Bytes.
+* @param sync: Erstes Byte der Nachricht.
+* @return Lnge in Bytes oder 0, wenn es kein Sync Byte ist.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t binaryFrameLength(uint8_t sync)
+{
+  uint8_t channels = sync & CHANNEL_ALL;
+
+  if (sync == BINARY_FRAME_SYNC) return BINARY_FRAME_LENGTH;
+  if (sync == BINARY_PREAMBLE_SYNC) return BINARY_PREAMBLE_LENGTH;
+  if ((sync & ~CHANNEL_ALL) != BINARY_PLAN_SYNC || channels == 0)
+  {
+    return 0;
+  }
+  return 4 + (channels & 1) + ((channels >> 1) & 1) + (channels >> 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert den Teiler eines Kanals aus dem Kanalplan.
+* @param planCode: Kanalplan aus dem Slow Word.
+* @param channel: Kanal 0..2 (Ch1..Ch3).
+* @return Jede wievielte Messung der Kanal gewandelt wird (1, 2 oder 4), 0 wenn er aus ist.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t planDivider(uint8_t planCode, uint8_t channel)
+{
+  uint8_t code = (planCode >> (4 - 2 * channel)) & 0b11;
+  return code == 3 ? 0 : (uint8_t)(1 << code);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erstellt einen Keyframe fr das Deltaformat.
+* @param framePtr: Puffer mit DELTA_KEYFRAME_LENGTH Bytes.
+* @param timecode: Timecode der Nachricht (die unteren 24 Bit werden verwendet).
+* @param valuesPtr: Ref, Ch1, Ch2, Ch3 (je 10 Bit).
+* @param segmentCrc: CRC ber die Deltaframes seit dem letzten Keyframe.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void encodeKeyFrame(uint8_t *framePtr, uint32_t timecode, const uint16_t *valuesPtr,
+                                  uint8_t segmentCrc)
+{
+  uint8_t crc = 0;
+  uint8_t count;
+
+  framePtr[0] = DELTA_KEYFRAME_SYNC;
+  framePtr[1] = (uint8_t)(timecode >> 16);
+  framePtr[2] = (uint8_t)(timecode >> 8);
+  framePtr[3] = (uint8_t)timecode;
+  framePtr[4] = (uint8_t)(valuesPtr[0] >> 2);
+  framePtr[5] = (uint8_t)(valuesPtr[0] << 6) | (uint8_t)((valuesPtr[1] >> 4) & 0x3F);
+  framePtr[6] = (uint8_t)(valuesPtr[1] << 4) | (uint8_t)((valuesPtr[2] >> 6) & 0x0F);
+  framePtr[7] = (uint8_t)(valuesPtr[2] << 2) | (uint8_t)((valuesPtr[3] >> 8) & 0x03);
+  framePtr[8] = (uint8_t)valuesPtr[3];
+  framePtr[9] = segmentCrc;
+  for (count = 1; count < DELTA_KEYFRAME_LENGTH - 1; count++)
+  {
+    crc = crc8Update(crc, framePtr[count]);
+  }
+  framePtr[DELTA_KEYFRAME_LENGTH - 1] = crc;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erstellt fr eine Messung einen Keyframe oder einen Deltaframe mit der kleinsten passenden
+* Breite. Die erste Messung muss den Timecode 0 haben (oder ein Vielfaches des Intervalls), damit
+* der Encoder mit einem Keyframe beginnt.
+* @param encoderPtr: Zustand des Encoders.
+* @param framePtr: Puffer mit DELTA_KEYFRAME_LENGTH Bytes.
+* @param timecode: Timecode der Messung.
+* @param valuesPtr: Ref, Ch1, Ch2, Ch3 (je 10 Bit).
+* @return Anzahl der Bytes in framePtr.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t encodeDeltaSample(DELTA_ENCODER *encoderPtr, uint8_t *framePtr,
+                                        uint32_t timecode, const uint16_t *valuesPtr)
+{
+  int16_t d1, d2, d3;
+  int16_t maxDelta, minDelta;
+  uint32_t bits;
+  uint8_t len;
+  uint8_t count;
+
+  d1 = (int16_t)(valuesPtr[1] - encoderPtr->lastValues[0]);
+  d2 = (int16_t)(valuesPtr[2] - encoderPtr->lastValues[1]);
+  d3 = (int16_t)(valuesPtr[3] - encoderPtr->lastValues[2]);
+  for (count = 0; count < 3; count++)
+  {
+    encoderPtr->lastValues[count] = valuesPtr[count+1];
+  }
+
+  if (!((uint8_t)timecode & (DELTA_KEYFRAME_INTERVAL - 1)))
+  {
+    encodeKeyFrame(framePtr, timecode, valuesPtr, encoderPtr->segmentCrc);
+    encoderPtr->segmentCrc = 0;
+    return DELTA_KEYFRAME_LENGTH;
+  }
+
+  maxDelta = d1 > d2 ? d1 : d2;
+  if (d3 > maxDelta) maxDelta = d3;
+  minDelta = d1 < d2 ? d1 : d2;
+  if (d3 < minDelta) minDelta = d3;
+
+  // Die Werte werden linksbndig in ein 32 Bit Wort geschrieben, davon werden len Bytes gesendet.
+  if (minDelta >= -2 && maxDelta <= 1)
+  {
+    bits = (0b00ul << 30) | ((uint32_t)(d1 & 0x03) << 28) | ((uint32_t)(d2 & 0x03) << 26) |
+           ((uint32_t)(d3 & 0x03) << 24);
+    len = 1;
+  }
+  else if (minDelta >= -8 && maxDelta <= 7)
+  {
+    bits = (0b01ul << 30) | ((uint32_t)(d1 & 0x0F) << 26) | ((uint32_t)(d2 & 0x0F) << 22) |
+           ((uint32_t)(d3 & 0x0F) << 18);
+    len = 2;
+  }
+  else if (minDelta >= -32 && maxDelta <= 31)
+  {
+    bits = (0b10ul << 30) | ((uint32_t)(d1 & 0x3F) << 24) | ((uint32_t)(d2 & 0x3F) << 18) |
+           ((uint32_t)(d3 & 0x3F) << 12);
+    len = 3;
+  }
+  else
+  {
+    bits = (0b11ul << 30) | ((uint32_t)(valuesPtr[1] & 0x3FF) << 20) |
+           ((uint32_t)(valuesPtr[2] & 0x3FF) << 10) | (uint32_t)(valuesPtr[3] & 0x3FF);
+    len = 4;
+  }
+
+  for (count = 0; count < len; count++)
+  {
+    framePtr[count] = (uint8_t)(bits >> 24);
+    bits <<= 8;
+    encoderPtr->segmentCrc = crc8Update(encoderPtr->segmentCrc, framePtr[count]);
+  }
+  return len;
+}
+
+#endif /* FRAMEFORMAT_H_ */
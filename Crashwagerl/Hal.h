@@ -0,0 +1,35 @@
+/*
+****************************************************************************************************
+HAL.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Bindet den Zugriff auf die Hardware ein. Am ATtiny45 sind das die Dateien mit den Registern
+       (AD Wandler, Scheduler, USI UART und Oszillator), am PC das Mock Backend aus dem Verzeichnis
+       Host, das synthetische Messwerte liefert und die gesendeten Bytes mitschreibt. main() und
+       die Codierung der Nachrichten verwenden nur diese Funktionen:
+         initOscillator, initAdc, initUart, initAdcScheduler   Initialisierung
+         readAdcValue, DELAY_US                                Messung vor dem Scheduler
+         waitForAdcFrame, readAdcRef                           Messwerte vom Scheduler
+         uartSendMessage, uartSendBytes, uartSendReversedBytes,
+         uartFlush                                             Senden
+       Vorher muss Crashwagerl.h eingebunden sein.
+****************************************************************************************************
+*/
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#ifdef __AVR__
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "UartLibrary.h"
+#include "AdcLibrary.h"
+#include "AdcScheduler.h"
+#include "OszillatorCalibration.h"
+#else
+#include "../Host/HostBackend.h"
+#endif
+
+#endif /* HAL_H_ */
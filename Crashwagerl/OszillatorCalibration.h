@@ -0,0 +1,153 @@
+/*
+****************************************************************************************************
+OSZILLATORCALIBRATION.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Kalibrierung des internen Oszillators auf F_CPU (7.3728 MHz). Liegt beim Einschalten am Pin
+       OSCCAL_REF_PIN ein Rechtecksignal mit OSCCAL_REF_HZ an (z. B. vom Funktionsgenerator),
+       wird OSCCAL so lange verndert, bis die Anzahl der CPU Zyklen in OSCCAL_REF_PERIODS Perioden
+       am besten passt. Der Wert wird im EEPROM gespeichert und bei jedem weiteren Start (ohne
+       Referenzsignal) verwendet. Ist das EEPROM leer, wird OSCILLATOR_CAL verwendet.
+       Damit muss OSCILLATOR_CAL nicht mehr fr jeden Chip mit dem Oszi eingestellt werden.
+       Die Messung verwendet den Timer 0, sie muss daher vor initUart() aufgerufen werden.
+****************************************************************************************************
+*/
+
+#ifndef OSZILLATORCALIBRATION_H_
+#define OSZILLATORCALIBRATION_H_
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stdlib.h>
+
+#ifndef OSCCAL_REF_PIN
+#error "OSCCAL_REF_PIN ist nicht definiert"
+#endif
+
+// Sollwert der Zyklen fr OSCCAL_REF_PERIODS Perioden des Referenzsignals.
+#define OSCCAL_TARGET_CYCLES ((uint32_t)(F_CPU / OSCCAL_REF_HZ * OSCCAL_REF_PERIODS))
+
+static uint8_t EEMEM eepromOscCal = 0xFF;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wartet auf die nchste steigende Flanke am OSCCAL_REF_PIN und liefert den Stand des Zyklenzhlers
+* (Timer 0 berlufe * 256 + TCNT0). Die Schleife prft das Overflow Flag fter als alle 256
+* Zyklen, es geht also kein berlauf verloren.
+* @param overflowsPtr: Zhler der Timer 0 berlufe, wird weitergezhlt.
+* @param timeoutOverflows: Maximale Anzahl an berlufen, bis abgebrochen wird.
+* @return Zyklenzhler bei der Flanke oder 0 bei Timeout.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t waitForRefEdge(uint16_t *overflowsPtr, uint16_t timeoutOverflows)
+{
+  uint8_t level;
+  uint8_t lastLevel = PINB & (1 << OSCCAL_REF_PIN);
+  uint8_t timerValue;
+
+  while (1)
+  {
+    if (TIFR & (1 << TOV0))
+    {
+      TIFR = (1 << TOV0);                  // Flag durch Schreiben von 1 lschen.
+      if (++(*overflowsPtr) >= timeoutOverflows) return 0;
+    }
+    level = PINB & (1 << OSCCAL_REF_PIN);
+    if (level && !lastLevel) break;
+    lastLevel = level;
+  }
+  timerValue = TCNT0;
+  // Ist der Timer gerade bergelaufen, wurde das Flag in der Schleife noch nicht gezhlt.
+  if ((TIFR & (1 << TOV0)) && timerValue < 128)
+  {
+    TIFR = (1 << TOV0);
+    (*overflowsPtr)++;
+  }
+  return ((uint32_t)*overflowsPtr << 8) | timerValue;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Misst die Anzahl der CPU Zyklen fr OSCCAL_REF_PERIODS Perioden des Referenzsignals.
+* @return Anzahl der Zyklen oder 0, wenn kein Referenzsignal anliegt oder die Frequenz um mehr
+*         als 1/8 vom Sollwert abweicht (z. B. ein analoges Signal am Pin).
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint32_t measureRefCycles()
+{
+  // 4 Perioden als Timeout, davon 1/8 Abweichung erlaubt.
+  const uint16_t timeoutOverflows = OSCCAL_TARGET_CYCLES / OSCCAL_REF_PERIODS * 4 / 256 + 1;
+  uint16_t overflows = 0;
+  uint32_t startCycles;
+  uint32_t endCycles = 0;
+  uint32_t cycles;
+  uint8_t count;
+
+  TCCR0A = 0;                      // Normal Mode, Timer luft von 0 bis 255.
+  TCNT0 = 0;
+  TIFR = (1 << TOV0);
+  TCCR0B = (0b001 << CS00);        // Prescale 1, der Timer zhlt CPU Zyklen.
+
+  startCycles = waitForRefEdge(&overflows, timeoutOverflows);
+  for (count = OSCCAL_REF_PERIODS; count && startCycles; count--)
+  {
+    endCycles = waitForRefEdge(&overflows, overflows + timeoutOverflows);
+    if (!endCycles) break;
+  }
+  TCCR0B = 0;
+
+  if (!startCycles || !endCycles) return 0;
+  cycles = endCycles - startCycles;
+  if (cycles < OSCCAL_TARGET_CYCLES - OSCCAL_TARGET_CYCLES / 8 ||
+      cycles > OSCCAL_TARGET_CYCLES + OSCCAL_TARGET_CYCLES / 8)
+  {
+    return 0;
+  }
+  return cycles;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Stellt OSCCAL ein. Liegt ein Referenzsignal an, wird OSCCAL in Schritten von 1 verndert, bis
+* der Fehler das Vorzeichen wechselt. Von den beiden letzten Werten wird der bessere genommen
+* und im EEPROM gespeichert. Lt. Datenblatt darf sich die Frequenz nicht um mehr als 2% auf einmal
+* ndern, deshalb wird nicht binr gesucht.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void initOscillator()
+{
+  uint8_t oscCal = eeprom_read_byte(&eepromOscCal);
+  uint32_t cycles;
+  int32_t error;
+  int32_t lastError;
+  int8_t direction;
+
+  if (oscCal == 0xFF) oscCal = OSCILLATOR_CAL;   // EEPROM leer
+  OSCCAL = oscCal;
+
+  if (!(cycles = measureRefCycles())) return;    // Kein Referenzsignal
+
+  error = (int32_t)cycles - (int32_t)OSCCAL_TARGET_CYCLES;
+  direction = error > 0 ? -1 : 1;                // Zu schnell: OSCCAL verkleinern.
+  do
+  {
+    lastError = error;
+    // Nicht ber die Grenze des Bereichs (0 - 127 bzw. 128 - 255) hinaus.
+    if ((uint8_t)(oscCal + direction) >> 7 != oscCal >> 7) break;
+    oscCal += direction;
+    OSCCAL = oscCal;
+    if (!(cycles = measureRefCycles())) return;  // Signal weg, eingestellten Wert nicht speichern.
+    error = (int32_t)cycles - (int32_t)OSCCAL_TARGET_CYCLES;
+  } while ((error > 0) == (lastError > 0) && error != 0);
+
+  // Der vorige Wert war nher am Sollwert.
+  if (labs(lastError) < labs(error))
+  {
+    oscCal -= direction;
+    OSCCAL = oscCal;
+  }
+  eeprom_update_byte(&eepromOscCal, oscCal);
+}
+
+#endif /* OSZILLATORCALIBRATION_H_ */
@@ -0,0 +1,41 @@
+/*
+****************************************************************************************************
+PROFILING.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Markierungen fr die Laufzeitmessung im Simulator (Host/crashprofile.c). Ist PROFILE_STAGES
+       1, schreibt main() den aktuellen Abschnitt in GPIOR0 und jede ISR setzt beim Eintritt ihr
+       Bit in GPIOR1 und lscht es beim Verlassen. Der Simulator protokolliert diese Schreibzugriffe
+       mit dem Zyklenzhler. Am Chip kosten die Markierungen 1 - 2 Zyklen, ist PROFILE_STAGES 0,
+       werden sie gar nicht bersetzt.
+****************************************************************************************************
+*/
+
+#ifndef PROFILING_H_
+#define PROFILING_H_
+
+#ifdef __AVR__
+#include <avr/io.h>
+#endif
+
+// Abschnitte von main(), werden in GPIOR0 geschrieben.
+#define PROFILE_WAIT         0    // Schlafen bis zur nchsten Messung, Werte holen
+#define PROFILE_ENCODE       1    // Nachricht codieren
+#define PROFILE_SEND         2    // Nachricht in den Sendepuffer kopieren
+
+// Bits der ISRs in GPIOR1.
+#define PROFILE_ISR_TIMER1   0
+#define PROFILE_ISR_ADC      1
+#define PROFILE_ISR_USI      2
+
+#if PROFILE_STAGES
+#define PROFILE_STAGE(stage)    (GPIOR0 = (stage))
+#define PROFILE_ISR_ENTER(bit)  (GPIOR1 |= (1 << (bit)))     // sbi, braucht kein Register
+#define PROFILE_ISR_LEAVE(bit)  (GPIOR1 &= ~(1 << (bit)))    // cbi
+#else
+#define PROFILE_STAGE(stage)
+#define PROFILE_ISR_ENTER(bit)
+#define PROFILE_ISR_LEAVE(bit)
+#endif
+
+#endif /* PROFILING_H_ */
@@ -4,7 +4,8 @@ UARTLIBRARY.H
 
 Autor: Michael Schletz, 21. November 2016
 Desc:  Headerdatei mit den inline Funktionen zum Senden von Nachrichten ber UART. Die 
-       Implementierung erfolgt ber das USI Register.
+       Implementierung erfolgt ber das USI Register. Gesendet wird interruptgesteuert aus einem
+       Ringpuffer, damit whrend der bertragung schon die nchste Messung laufen kann.
 ****************************************************************************************************
 */
 
@@ -12,28 +13,33 @@ Desc:  Headerdatei mit den inline Funktionen zum Senden von Nachrichten 
 #define UARTLIBRARY_H_
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <util/atomic.h>
 
+#include "Profiling.h"
+
 #ifndef UART_TIMER_CYCLES
 #error "UART_TIMER_CYCLES ist nicht definiert"
 #endif
+#ifndef UART_TX_BUFFER_SIZE
+#error "UART_TX_BUFFER_SIZE ist nicht definiert"
+#endif
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) || UART_TX_BUFFER_SIZE > 128
+#error "UART_TX_BUFFER_SIZE muss eine 2er Potenz bis 128 sein"
+#endif
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-/**
-* Dreht alle Bits eines Bytes in der Reihenfolge um, macht also aus 10001011 -> 11010001. Das ist
-* fr die bertragung ber das USI Schieberegister ntig.
-* @param val: Bytewert
-* @return Umgedrehtes Byte
-*/
-////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline uint8_t reverseByte (uint8_t x)
-{
-  x = ((x & 0x55) << 1) | ((x & 0xaa) >> 1);
-  x = ((x & 0x33) << 2) | ((x & 0xcc) >> 2);
-  __asm__ volatile ("swap %0" : "=r" (x) : "0" (x)); /* swap nibbles. */
-  return x;
-}
+#define UART_TX_BUFFER_MASK (UART_TX_BUFFER_SIZE - 1)
+
+typedef enum {UART_TX_IDLE, UART_TX_FIRST_HALF, UART_TX_SECOND_HALF} UART_TX_STATES;
 
+// Ringpuffer fr die zu sendenden (schon umgedrehten) Bytes. uartSendMessage schreibt bei Head,
+// die USI Overflow ISR liest bei Tail. Ein Platz bleibt immer frei, damit voll von leer
+// unterschieden werden kann.
+static volatile uint8_t uartTxBuffer[UART_TX_BUFFER_SIZE];
+static volatile uint8_t uartTxHead = 0;
+static volatile uint8_t uartTxTail = 0;
+static volatile uint8_t uartTxSecondHalf;
+static volatile UART_TX_STATES uartTxState = UART_TX_IDLE;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
@@ -55,50 +61,243 @@ static inline void initUart()
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
-* Kopiert jedes Bytes des MessagePointers (exkl. \0) in den TxBuffer, damit die ISR das Byte
-* senden kann. Diese Funktion arbeitet synchron, d. h. sie blockiert den Programmablauf bis
-* alle Bytes gesendet wurden.
-* @param messagePtr: Pointer auf die zu sendende Nachricht, muss mit \0 terminiert sein.
-* @param uartTxBufferPtr: Pointer auf den Transmitpuffer, der vom Timer abgearbeitet wird.
+* Ladet das nchste Byte aus dem TxBuffer in das USI Schieberegister und startet den Timer 0. Wird
+* aus uartSendMessage (wenn der Sender steht) und aus der USI Overflow ISR aufgerufen. Das Byte
+* liegt im Puffer bereits umgedreht vor.
+* Der 10 Bit lange UART Frame wird in 2 Teilen bertragen. Der 1. Teil lst nach 3 Bits (Start,
+* D0, D1) den Overflow Interrupt aus, die ISR ladet dann whrend D4 am Pin liegt den 2. Teil.
+* Muss bei deaktivierten Interrupts aufgerufen werden.
 * @return void
 */
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-static inline void uartSendMessage(const char * messagePtr)
+static inline void uartStartByte()
 {
-  uint8_t reversedByte;
+  uint8_t reversedByte = uartTxBuffer[uartTxTail];
 
-  while ((reversedByte = reverseByte(*messagePtr++)))
+  uartTxTail = (uartTxTail + 1) & UART_TX_BUFFER_MASK;
+  // D4 D5 D6 D7 1 1 1 1 schon jetzt berechnen, damit die ISR nur mehr schreiben muss.
+  uartTxSecondHalf = (reversedByte << 4) | 0b1111;
+  uartTxState = UART_TX_FIRST_HALF;
+
+  // Damit das erste Bit auch die volle Lnge hat, darf der Timerstand nicht undefiniert sein.
+  // Der Timer muss allerdings mit 1 initialisiert werden, da das Aktivieren des Timers 1 
+  // Instruktion nach dem Aktivieren des USI erfolgt.
+  TCNT0 = 1;
+  // Das Schieberegister mit folgenden Daten aufbereiten:
+  // 0  D0 D1 D2 D3 D4 D5 D6
+  USIDR = (reversedByte >> 1);
+  // Der Zhler im USISR soll bei 13 beginnen. Er luft bei 15 ber und setzt das USIOIF Flag.
+  // Somit wird der Interrupt nach 3 Bits ausgelst, D2 liegt dann gerade am Pin.
+  USISR = (1 << USIOIF) | 13;
+  // USI Clock Source ist der Timer 0, Modus ist 3 Wire Mode, Overflow Interrupt aktivieren.
+  USICR = (1 << USIOIE) | (0b01 << USIWM0) | (0b01 << USICS0);
+  // Timer starten, das USI schiebt nun bei jedem Compare Match 1 Bit raus.
+  TCCR0B = (0b001 << CS00);        // Prescale 1
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ISR fr den USI Counter Overflow. Nach dem 1. Teil des Frames wird der 2. Teil geladen, nach dem
+* 2. Teil (Stoppbits) wird das nchste Byte aus dem TxBuffer gestartet oder der Sender gestoppt.
+* Beides passiert an einer Bitgrenze, die ISR wartet dafr aktiv auf den USI Zhler. Kommt sie zu
+* spt (eine andere ISR oder ein cli() Abschnitt war davor), wird nicht auf einen Zhlerstand
+* gewartet, der schon vorbei ist:
+* - Beim 1. Teil liegen dann schon D4 oder D5 am Pin. Ab der nchsten Bitgrenze wird der Rest
+*   des 2. Teils geladen. Das Byte bleibt richtig, wenn die ISR den Zhler sptestens bei 3 liest
+*   (rd. 4 Bits = 64 Zyklen nach dem Overflow). Sonst wird bis zum Ende des Frames 1 gesendet,
+*   das Byte ist falsch und der Empfnger verwirft die Nachricht, die folgenden Bytes bleiben
+*   aber im Takt.
+* - Der 2. Teil luft schon beim 2. Stoppbit ber, danach sind noch 2 Bits 1 im Schieberegister.
+*   Die ISR wartet das Ende des 2. Stoppbits ab, meist ist es beim Eintritt schon vorbei. Sie darf
+*   rd. 2 Bits zu spt kommen, bevor das USI den Pegel von DI (PB0) hinausschiebt.
+* @param USI_OVF_vect: Interruptvektor aus interrupt.h
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+ISR(USI_OVF_vect)
+{
+  // Bei Zhlerstand n nach dem Overflow des 1. Teils liegt D(n + 2) am Pin, bis D6 (4) kommt das
+  // Bit noch aus dem 1. Teil.
+  uint8_t count = USISR & 0x0F;
+
+  PROFILE_ISR_ENTER(PROFILE_ISR_USI);
+  if (uartTxState == UART_TX_FIRST_HALF)
   {
-    // Damit das erste Bit auch die volle Lnge hat, darf der Timerstand nicht undefiniert sein.
-    // Der Timer muss allerdings mit 1 initialisiert werden, da das Aktivieren des Timers 1 
-    // Instruktion nach dem Aktivieren des USI erfolgt.
-    TCNT0 = 1;
-    // Das Schieberegister mit folgenden Daten aufbereiten:
-    // 0  D0 D1 D2 D3 D4 D5 D6
-    // Wir mit dem Startbit (0) und es folgen bei der ersten bertragung 4 Datenbits.
-    USIDR = (reversedByte >> 1);
-    // Der Zhler im USISR soll bei 11 beginnen. Er luft bei 15 ber und setzt das USIOIF Flag.
-    // Somit werden hier 5 Bits rausgeschrieben.
-    USISR = (1 << USIOIF) | 11;
-    // USI Clock Source ist der Timer 0, Modus ist 3 Wire Mode.
-    USICR = (0b01 << USIWM0) | (0b01 << USICS0);
-    // Timer starten, das USI schiebt nun bei jedem Compare Match 1 Bit raus.
-    TCCR0B = (0b001 << CS00);        // Prescale 1
-    // Warten, bis der USI Counter das Overflow Flag setzt.
-    while (!(USISR & (1 << USIOIF)));
-
-    // Nun bertragen wir den 2. Teil des 10 Bit langen UART Frames. Dabei muss sich der Inhalt
-    // des USIDR um mindestens 1 Bit berlappen, da nderungen sofort geschrieben werden.
-    // Wir lassen den Timer ab 10 laufen, damit ein 2. Stoppbit bertragen wird. Dies verbessert
     // D4 D5 D6 D7 1 1 1 1
-    USIDR = (reversedByte << 4) | 0b1111;
-    // USI Overflow Flag lschen
-    USISR = (1 << USIOIF) | 10;
-    while (!(USISR & (1 << USIOIF)));
-    // Timer und USI deaktivieren.
+    uint8_t secondHalf = uartTxSecondHalf;
+
+    if (count < 2)
+    {
+      // Warten, bis D4 am Pin liegt (2 Bits nach dem Overflow). Dabei muss sich der Inhalt
+      // des USIDR um mindestens 1 Bit berlappen, da nderungen sofort geschrieben werden.
+      while ((USISR & 0x0F) < 2);
+      count = 2;
+    }
+    else
+    {
+      uint8_t lateCount = count;
+      if (count < 4)
+      {
+        // Die bis zur nchsten Bitgrenze gesendeten Bits vorne wegschieben, hinten mit 1 auffllen.
+        count++;
+        secondHalf = (uint8_t)(secondHalf << (count - 2)) | ((1 << (count - 2)) - 1);
+      }
+      else
+      {
+        // Das Byte ist nicht mehr zu retten.
+        secondHalf = 0xFF;
+        count = 2;
+      }
+      // Mit der nchsten Bitgrenze laden. Auf eine nderung warten, nicht auf einen Zhlerstand,
+      // damit eine verpasste Grenze nicht einen ganzen Zhlerumlauf kostet.
+      while ((USISR & 0x0F) == lateCount);
+    }
+    USIDR = secondHalf;
+    // Nach D7 und dem 1. Stoppbit luft der Zhler ber, das 2. Stoppbit liegt dann am Pin.
+    USISR = (1 << USIOIF) | (count + 9);
+    uartTxState = UART_TX_SECOND_HALF;
+  }
+  else
+  {
+    // Ende des 2. Stoppbits abwarten.
+    while ((USISR & 0x0F) < 1);
+    // Timer und USI deaktivieren, der Pin geht auf den IDLE Pegel (PORTB).
     TCCR0B = 0;
     USICR = 0;
+    if (uartTxHead != uartTxTail)
+    {
+      uartStartByte();
+    }
+    else
+    {
+      uartTxState = UART_TX_IDLE;
+    }
   }
+  PROFILE_ISR_LEAVE(PROFILE_ISR_USI);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert, ob der Sender gerade Bytes bertrgt. Solange das der Fall ist, darf die CPU nicht in
+* einen Sleep Mode gehen, der den I/O Takt (und damit den Timer 0) anhlt.
+* @return 1 wenn gesendet wird, sonst 0.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t uartIsBusy()
+{
+  return uartTxState != UART_TX_IDLE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schreibt ein schon umgedrehtes Byte in den TxBuffer. Blockiert nur, wenn der TxBuffer voll ist,
+* bis die ISR ein Byte geholt hat.
+* @param reversedByte: Zu sendendes Byte mit umgedrehten Bits (s. reverseByte).
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartQueueReversedByte(uint8_t reversedByte)
+{
+  uint8_t nextHead = (uartTxHead + 1) & UART_TX_BUFFER_MASK;
+
+  while (nextHead == uartTxTail);      // Puffer voll, warten bis die ISR ein Byte holt.
+  uartTxBuffer[uartTxHead] = reversedByte;
+  uartTxHead = nextHead;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Dreht die Bits eines Bytes um und schreibt es in den TxBuffer.
+* @param val: Zu sendendes Byte.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartQueueByte(uint8_t val)
+{
+  uartQueueReversedByte(reverseByte(val));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Startet den Sender, wenn er steht und Bytes im TxBuffer sind. Danach holt sich die ISR die
+* weiteren Bytes selbst.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartStartTransmit()
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (uartTxState == UART_TX_IDLE && uartTxHead != uartTxTail)
+    {
+      uartStartByte();
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Kopiert jedes Bytes des MessagePointers (exkl. \0) in den TxBuffer, damit die ISR das Byte
+* senden kann. Die Bits werden dabei schon umgedreht. Die Funktion blockiert nur, wenn der 
+* TxBuffer voll ist. Sonst kehrt sie sofort zurck, whrend die ISR im Hintergrund sendet. Die 
+* Nachricht kann daher sofort wieder berschrieben werden.
+* @param messagePtr: Pointer auf die zu sendende Nachricht, muss mit \0 terminiert sein.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartSendMessage(const char * messagePtr)
+{
+  while (*messagePtr)
+  {
+    uartQueueByte(*messagePtr++);
+  }
+  uartStartTransmit();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wie uartSendMessage, aber fr binre Daten mit fixer Lnge (die auch 0 Bytes enthalten knnen).
+* @param dataPtr: Pointer auf die zu sendenden Bytes.
+* @param len: Anzahl der Bytes.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartSendBytes(const uint8_t * dataPtr, uint8_t len)
+{
+  while (len--)
+  {
+    uartQueueByte(*dataPtr++);
+  }
+  uartStartTransmit();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wie uartSendBytes, die Bytes sind aber schon umgedreht (z. B. aus encodeBase64Frame). Das
+* Kopieren braucht dann fr jeden Inhalt gleich viele Zyklen.
+* @param dataPtr: Pointer auf die zu sendenden, umgedrehten Bytes.
+* @param len: Anzahl der Bytes.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartSendReversedBytes(const uint8_t * dataPtr, uint8_t len)
+{
+  while (len--)
+  {
+    uartQueueReversedByte(*dataPtr++);
+  }
+  uartStartTransmit();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wartet, bis alle Bytes im TxBuffer gesendet wurden.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uartFlush()
+{
+  while (uartIsBusy());
 }
 
 #endif /* UARTLIBRARY_H_ */
@@ -0,0 +1,270 @@
+/*
+****************************************************************************************************
+CAPTUREFILE.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Schreibt Messwerte spaltenweise in ein Verzeichnis (POSIX, C++17). Jede Spalte ist eine
+       eigene Datei mit Werten in der Byte Reihenfolge des Rechners (Little Endian):
+         time.u64                   Fortlaufende Zeit (s. CrashwagerlReceiver.h)
+         ref.u16, ch1.u16, ...      Messwerte
+         index.u64                  Paare (Zeit, Zeile) fr jede CAPTURE_INDEX_INTERVAL. Zeile
+       Kanle, die laut Kanalplan in einer Messung nicht gewandelt wurden, haben den Wert
+       CAPTURE_NO_VALUE (0xFFFF).
+       Die Dateien werden mit mmap in Schritten von CAPTURE_GROW_ROWS Zeilen vergrert (index.u64
+       und pyramid.bin in kleineren Schritten, passend zu ihrem Wachstum), beim Schlieen auf die
+       tatschliche Lnge gekrzt. Sie knnen z. B. mit numpy.memmap gelesen werden. ber den
+       Index findet man eine Zeit, ohne die ganze Zeitspalte zu lesen. Minimum, Maximum und
+       Mittelwert ber groe Bereiche liefert pyramid.bin (PyramidIndex.h).
+****************************************************************************************************
+*/
+
+#ifndef CAPTUREFILE_H_
+#define CAPTUREFILE_H_
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CrashwagerlReceiver.h"
+
+namespace crashwagerl
+{
+
+constexpr size_t CAPTURE_GROW_ROWS = 1 << 20;      // 1 M Zeilen, bei 1 kHz rd. 17 min
+constexpr size_t CAPTURE_INDEX_INTERVAL = 4096;
+// index.u64 hat 2 Eintrge pro CAPTURE_INDEX_INTERVAL Zeilen, wchst also entsprechend langsamer.
+constexpr size_t CAPTURE_INDEX_GROW_ROWS = 2 * CAPTURE_GROW_ROWS / CAPTURE_INDEX_INTERVAL;
+constexpr uint16_t CAPTURE_NO_VALUE = 0xFFFF;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Eine Spalte mit Elementen vom Typ T in einer eigenen Datei.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class T>
+class MappedColumn
+{
+public:
+  // growRows: Schritt, in dem die Datei vergrert wird.
+  explicit MappedColumn(size_t growRows = CAPTURE_GROW_ROWS) : growRows_(growRows) {}
+  MappedColumn(const MappedColumn &) = delete;
+  MappedColumn &operator=(const MappedColumn &) = delete;
+  // Ohne close() bleibt die Datei in der vergrerten Lnge stehen, es geht aber nichts verloren.
+  ~MappedColumn()
+  {
+    if (fd_ < 0) return;
+    unmap();
+    ::close(fd_);
+  }
+
+  bool open(const std::string &fileName)
+  {
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+    {
+      perror(fileName.c_str());
+      return false;
+    }
+    fileName_ = fileName;
+    return true;
+  }
+
+  // Schreibt einen Wert in die Zeile row. Die Datei wird bei Bedarf vergrert.
+  bool set(size_t row, T value)
+  {
+    if (row >= capacity_ && !grow(row + 1)) return false;
+    data_[row] = value;
+    return true;
+  }
+
+  // Krzt die Datei auf rows Zeilen und schliet sie.
+  void close(size_t rows)
+  {
+    if (fd_ < 0) return;
+    unmap();
+    if (ftruncate(fd_, rows * sizeof(T)) < 0) perror(fileName_.c_str());
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+private:
+  bool grow(size_t rows)
+  {
+    size_t capacity = capacity_ + growRows_;
+    while (capacity < rows) capacity += growRows_;
+    unmap();
+    if (ftruncate(fd_, capacity * sizeof(T)) < 0)
+    {
+      perror(fileName_.c_str());
+      return false;
+    }
+    void *mapPtr = mmap(nullptr, capacity * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapPtr == MAP_FAILED)
+    {
+      perror(fileName_.c_str());
+      return false;
+    }
+    data_ = static_cast<T *>(mapPtr);
+    capacity_ = capacity;
+    return true;
+  }
+
+  void unmap()
+  {
+    if (data_) munmap(data_, capacity_ * sizeof(T));
+    data_ = nullptr;
+    capacity_ = 0;
+  }
+
+  size_t growRows_;
+  int fd_ = -1;
+  std::string fileName_;
+  T *data_ = nullptr;
+  size_t capacity_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Eine Datei, die nur gelesen und komplett mit mmap abgebildet wird.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class T>
+class ReadOnlyColumn
+{
+public:
+  ReadOnlyColumn() = default;
+  ReadOnlyColumn(const ReadOnlyColumn &) = delete;
+  ReadOnlyColumn &operator=(const ReadOnlyColumn &) = delete;
+  ~ReadOnlyColumn()
+  {
+    if (data_) munmap(const_cast<T *>(data_), size_ * sizeof(T));
+  }
+
+  bool open(const std::string &fileName)
+  {
+    struct stat status;
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &status) < 0)
+    {
+      perror(fileName.c_str());
+      if (fd >= 0) ::close(fd);
+      return false;
+    }
+    size_ = status.st_size / sizeof(T);
+    if (size_)
+    {
+      void *mapPtr = mmap(nullptr, size_ * sizeof(T), PROT_READ, MAP_SHARED, fd, 0);
+      if (mapPtr == MAP_FAILED)
+      {
+        perror(fileName.c_str());
+        ::close(fd);
+        return false;
+      }
+      data_ = static_cast<const T *>(mapPtr);
+    }
+    ::close(fd);
+    return true;
+  }
+
+  size_t size() const { return size_; }
+  const T *begin() const { return data_; }
+  const T *end() const { return data_ + size_; }
+  const T &operator[](size_t index) const { return data_[index]; }
+
+private:
+  const T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Aufzeichnung mit allen Spalten und dem Index.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class CaptureFile
+{
+public:
+  ~CaptureFile() { close(); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Legt das Verzeichnis an (falls ntig) und ffnet alle Spalten.
+  * @param directory: Verzeichnis der Aufzeichnung.
+  * @return false bei einem Fehler (wurde schon mit perror ausgegeben).
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool open(const std::string &directory)
+  {
+    if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+      perror(directory.c_str());
+      return false;
+    }
+    rows_ = 0;
+    indexRows_ = 0;
+    return time_.open(directory + "/time.u64") && ref_.open(directory + "/ref.u16") &&
+           ch1_.open(directory + "/ch1.u16") && ch2_.open(directory + "/ch2.u16") &&
+           ch3_.open(directory + "/ch3.u16") && index_.open(directory + "/index.u64");
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Hngt einen Messwert an.
+  * @param sample: Messwert.
+  * @return false, wenn die Dateien nicht vergrert werden konnten.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool append(const TimedSample &sample)
+  {
+    if (rows_ % CAPTURE_INDEX_INTERVAL == 0)
+    {
+      if (!index_.set(2 * indexRows_, sample.time) || !index_.set(2 * indexRows_ + 1, rows_))
+      {
+        return false;
+      }
+      indexRows_++;
+    }
+    if (!time_.set(rows_, sample.time) || !ref_.set(rows_, sample.ref) ||
+        !ch1_.set(rows_, sample.channels & 1 ? sample.ch1 : CAPTURE_NO_VALUE) ||
+        !ch2_.set(rows_, sample.channels & 2 ? sample.ch2 : CAPTURE_NO_VALUE) ||
+        !ch3_.set(rows_, sample.channels & 4 ? sample.ch3 : CAPTURE_NO_VALUE))
+    {
+      return false;
+    }
+    rows_++;
+    return true;
+  }
+
+  void close()
+  {
+    time_.close(rows_);
+    ref_.close(rows_);
+    ch1_.close(rows_);
+    ch2_.close(rows_);
+    ch3_.close(rows_);
+    index_.close(2 * indexRows_);
+  }
+
+  size_t rows() const { return rows_; }
+
+private:
+  MappedColumn<uint64_t> time_;
+  MappedColumn<uint16_t> ref_;
+  MappedColumn<uint16_t> ch1_;
+  MappedColumn<uint16_t> ch2_;
+  MappedColumn<uint16_t> ch3_;
+  MappedColumn<uint64_t> index_{CAPTURE_INDEX_GROW_ROWS};
+  size_t rows_ = 0;
+  size_t indexRows_ = 0;
+};
+
+}  // namespace crashwagerl
+
+#endif /* CAPTUREFILE_H_ */
@@ -0,0 +1,409 @@
+/*
+****************************************************************************************************
+CRASHWAGERLBULKDECODER.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Schneller Decoder fr das base64 Format (12 Zeichen + CR LF) zum Einlesen von langen
+       Aufzeichnungen (C++17). Statt jedes Zeichen einzeln zu prfen, werden ganze Nachrichten
+       auf einmal decodiert:
+         - Mit AVX2 2 Nachrichten pro Durchlauf (je eine pro 128 Bit Hlfte),
+         - mit SSSE3 1 Nachricht pro Durchlauf,
+         - sonst ber eine Tabelle mit 256 Eintrgen.
+       Welcher Weg verwendet wird, entscheidet der Compiler (z. B. -march=native oder -mavx2).
+       Die Messwerte werden spaltenweise (SampleColumns) abgelegt, damit sie direkt weiter-
+       verarbeitet (Filter, Plot, ...) werden knnen. Ergebnisse und Zhler sind identisch mit
+       Base64FrameDecoder, das prft Host/crashbench.cpp.
+****************************************************************************************************
+*/
+
+#ifndef CRASHWAGERLBULKDECODER_H_
+#define CRASHWAGERLBULKDECODER_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "CrashwagerlDecoder.h"
+
+namespace crashwagerl
+{
+
+// Decodierte Messwerte als Spalten. Alle Vektoren sind gleich lang.
+struct SampleColumns
+{
+  std::vector<uint32_t> timecode;
+  std::vector<uint16_t> ref;
+  std::vector<uint16_t> ch1;
+  std::vector<uint16_t> ch2;
+  std::vector<uint16_t> ch3;
+
+  size_t size() const { return timecode.size(); }
+
+  void resize(size_t count)
+  {
+    timecode.resize(count);
+    ref.resize(count);
+    ch1.resize(count);
+    ch2.resize(count);
+    ch3.resize(count);
+  }
+
+  void clear() { resize(0); }
+};
+
+// Zeiger auf die nchste freie Zeile in den Spalten.
+struct ColumnWriter
+{
+  uint32_t *timecode;
+  uint16_t *ref;
+  uint16_t *ch1;
+  uint16_t *ch2;
+  uint16_t *ch3;
+};
+
+// Tabelle Zeichen -> Wert (0 - 63), 0xFF fr ungltige Zeichen.
+constexpr std::array<uint8_t, 256> makeBase64Table()
+{
+  std::array<uint8_t, 256> table{};
+  for (size_t i = 0; i < 256; i++) table[i] = 0xFF;
+  for (uint8_t i = 0; i < 26; i++) table['A' + i] = i;
+  for (uint8_t i = 0; i < 26; i++) table['a' + i] = 26 + i;
+  for (uint8_t i = 0; i < 10; i++) table['0' + i] = 52 + i;
+  table['+'] = 62;
+  table['/'] = 63;
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 256> base64Table = makeBase64Table();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert eine Nachricht ber die Tabelle.
+* @param framePtr: 14 Bytes ab dem Anfang der Zeile.
+* @param out: Ziel, index ist die Zeile.
+* @param index: Zeile in out.
+* @return false, wenn die Zeile keine gltige Nachricht ist.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline bool decodeBase64FrameScalar(const uint8_t *framePtr, const ColumnWriter &out, size_t index)
+{
+  uint8_t v[12];
+  uint8_t invalid = 0;
+
+  if (framePtr[12] != '\r' || framePtr[13] != '\n') return false;
+  for (size_t i = 0; i < 12; i++)
+  {
+    v[i] = base64Table[framePtr[i]];
+    invalid |= v[i];
+  }
+  if (invalid & 0xC0) return false;       // Nur ungltige Zeichen haben Bit 6 oder 7 gesetzt.
+
+  out.timecode[index] = (uint32_t(v[0]) << 18) | (v[1] << 12) | (v[2] << 6) | v[3];
+  out.ref[index] = static_cast<uint16_t>((v[4] << 6) | v[5]);
+  out.ch1[index] = static_cast<uint16_t>((v[6] << 6) | v[7]);
+  out.ch2[index] = static_cast<uint16_t>((v[8] << 6) | v[9]);
+  out.ch3[index] = static_cast<uint16_t>((v[10] << 6) | v[11]);
+  return true;
+}
+
+#if defined(__SSSE3__) || defined(__AVX2__)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wandelt 16 Zeichen in ihre Werte um (Verfahren nach W. Mula, Tabellen ber das obere und untere
+* Halbbyte). Gleichzeitig wird eine Maske der ungltigen Zeichen erzeugt.
+* @param chars: 16 Zeichen.
+* @param invalidPtr: Lane ist ungleich 0, wenn das Zeichen ungltig ist.
+* @return Werte 0 - 63.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline __m128i base64CharsToValues(__m128i chars, __m128i *invalidPtr)
+{
+  const __m128i lutLow  = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                        0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lutHigh = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                        0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                        0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i slash = _mm_set1_epi8('/');
+
+  __m128i high = _mm_and_si128(_mm_srli_epi32(chars, 4), nibble);
+  __m128i low = _mm_and_si128(chars, nibble);
+  *invalidPtr = _mm_and_si128(_mm_shuffle_epi8(lutLow, low), _mm_shuffle_epi8(lutHigh, high));
+  // '/' liegt im selben oberen Halbbyte wie '+', bekommt aber einen anderen Offset.
+  __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(_mm_cmpeq_epi8(chars, slash), high));
+  return _mm_add_epi8(chars, roll);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Setzt aus den Werten einer Nachricht die Felder zusammen. pmaddubsw bildet aus je 2 Zeichen
+* v[2i] * 64 + v[2i+1], der Timecode besteht aus den ersten beiden Wrtern.
+* @param values: Werte der Zeichen 0..11.
+* @param out: Ziel.
+* @param index: Zeile in out.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline void storeBase64Values(__m128i values, const ColumnWriter &out, size_t index)
+{
+  alignas(16) uint16_t words[8];
+  _mm_store_si128(reinterpret_cast<__m128i *>(words),
+                  _mm_maddubs_epi16(values, _mm_set1_epi16(0x0140)));
+  out.timecode[index] = (uint32_t(words[0]) << 12) | words[1];
+  out.ref[index] = words[2];
+  out.ch1[index] = words[3];
+  out.ch2[index] = words[4];
+  out.ch3[index] = words[5];
+}
+
+// Nur die Zeichen 0..11 werden geprft, dahinter stehen CR LF und die nchste Nachricht.
+constexpr int BASE64_FRAME_CHAR_MASK = 0x0FFF;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert eine Nachricht mit SSSE3. Liest 16 Bytes, es mssen also noch 2 Bytes nach der
+* Nachricht im Puffer sein.
+* @param framePtr: Anfang der Zeile.
+* @param out: Ziel.
+* @param index: Zeile in out.
+* @return false, wenn die Zeile keine gltige Nachricht ist.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline bool decodeBase64FrameSsse3(const uint8_t *framePtr, const ColumnWriter &out, size_t index)
+{
+  __m128i invalid;
+  __m128i values;
+
+  if (framePtr[12] != '\r' || framePtr[13] != '\n') return false;
+  values = base64CharsToValues(_mm_loadu_si128(reinterpret_cast<const __m128i *>(framePtr)),
+                               &invalid);
+  if (~_mm_movemask_epi8(_mm_cmpeq_epi8(invalid, _mm_setzero_si128())) & BASE64_FRAME_CHAR_MASK)
+  {
+    return false;
+  }
+  storeBase64Values(values, out, index);
+  return true;
+}
+#endif
+
+#if defined(__AVX2__)
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert 2 aufeinanderfolgende Nachrichten mit AVX2. Jede Nachricht wird in eine 128 Bit Hlfte
+* geladen, da vpshufb nicht ber die Hlften hinweg arbeitet. Liest 30 Bytes.
+* @param framePtr: Anfang der ersten Zeile.
+* @param out: Ziel.
+* @param index: Zeile der ersten Nachricht in out.
+* @return false, wenn eine der beiden Zeilen keine gltige Nachricht ist (dann wird nichts
+*         geschrieben).
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline bool decodeBase64PairAvx2(const uint8_t *framePtr, const ColumnWriter &out, size_t index)
+{
+  const __m256i lutLow  = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                           0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m256i lutHigh = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0,
+                                           0, 16, 19, 4, -65, -65, -71, -71,
+                                           0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i slash = _mm256_set1_epi8('/');
+  const __m256i lineEnd = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\r', '\n', 0, 0,
+                                           0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\r', '\n', 0, 0);
+
+  __m256i chars = _mm256_inserti128_si256(
+      _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(framePtr))),
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(framePtr + BASE64_FRAME_LENGTH)), 1);
+
+  __m256i high = _mm256_and_si256(_mm256_srli_epi32(chars, 4), nibble);
+  __m256i low = _mm256_and_si256(chars, nibble);
+  __m256i invalid = _mm256_and_si256(_mm256_shuffle_epi8(lutLow, low),
+                                     _mm256_shuffle_epi8(lutHigh, high));
+  // Gltig: Zeichen 0..11 ohne Fehlerbit, Zeichen 12 und 13 gleich CR LF.
+  uint32_t validChars =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(invalid, _mm256_setzero_si256()));
+  uint32_t validLineEnd = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, lineEnd));
+  if (((validChars & 0x0FFF0FFF) | (validLineEnd & 0x30003000)) != 0x3FFF3FFF) return false;
+
+  __m256i roll = _mm256_shuffle_epi8(lutRoll,
+                                     _mm256_add_epi8(_mm256_cmpeq_epi8(chars, slash), high));
+  __m256i values = _mm256_add_epi8(chars, roll);
+  alignas(32) uint16_t words[16];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(words),
+                     _mm256_maddubs_epi16(values, _mm256_set1_epi16(0x0140)));
+  for (size_t i = 0; i < 2; i++)
+  {
+    const uint16_t *w = words + 8 * i;
+    out.timecode[index + i] = (uint32_t(w[0]) << 12) | w[1];
+    out.ref[index + i] = w[2];
+    out.ch1[index + i] = w[3];
+    out.ch2[index + i] = w[4];
+    out.ch3[index + i] = w[5];
+  }
+  return true;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert einen Block, der am Anfang einer Zeile beginnt und mit LF endet. Ungltige Zeilen
+* werden wie im Base64FrameDecoder gezhlt.
+* @param dataPtr: Empfangene Bytes.
+* @param len: Anzahl der Bytes, das letzte Byte ist LF.
+* @param out: Ziel, muss Platz fr (len + 1) / BASE64_FRAME_LENGTH Zeilen haben.
+* @param stats: Zhler.
+* @return Anzahl der decodierten Nachrichten.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline size_t decodeBase64Block(const uint8_t *dataPtr, size_t len, const ColumnWriter &out,
+                                DecoderStats &stats)
+{
+  size_t pos = 0;
+  size_t count = 0;
+
+  while (pos < len)
+  {
+#if defined(__AVX2__)
+    while (pos + 2 * BASE64_FRAME_LENGTH + 2 <= len &&
+           decodeBase64PairAvx2(dataPtr + pos, out, count))
+    {
+      pos += 2 * BASE64_FRAME_LENGTH;
+      count += 2;
+    }
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+    while (pos + BASE64_FRAME_LENGTH + 2 <= len &&
+           decodeBase64FrameSsse3(dataPtr + pos, out, count))
+    {
+      pos += BASE64_FRAME_LENGTH;
+      count++;
+    }
+#endif
+    if (pos + BASE64_FRAME_LENGTH <= len && decodeBase64FrameScalar(dataPtr + pos, out, count))
+    {
+      pos += BASE64_FRAME_LENGTH;
+      count++;
+      continue;
+    }
+    if (pos >= len) break;
+
+    // Keine gltige Nachricht: bis zum nchsten LF berspringen.
+    const uint8_t *lineEndPtr =
+        static_cast<const uint8_t *>(std::memchr(dataPtr + pos, '\n', len - pos));
+    size_t lineLength = lineEndPtr - (dataPtr + pos);
+    if (lineLength > 0) stats.corrupted++;
+    if (lineLength > BASE64_FRAME_LENGTH) stats.skippedBytes += lineLength - BASE64_FRAME_LENGTH;
+    pos += lineLength + 1;
+  }
+  stats.frames += count;
+  return count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decoder fr das base64 Format, der die Messwerte an SampleColumns anhngt. Die Bytes knnen wie
+* beim Base64FrameDecoder in beliebig groen Blcken bergeben werden, fr eine gute Leistung
+* sollten es aber einige kB sein.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class Base64BulkDecoder
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Verarbeitet die bergebenen Bytes und hngt die gltigen Nachrichten an columns an.
+  * @param dataPtr: Empfangene Bytes.
+  * @param len: Anzahl der Bytes.
+  * @param columns: Ziel.
+  * @return Anzahl der neuen Messwerte.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  size_t feed(const uint8_t *dataPtr, size_t len, SampleColumns &columns)
+  {
+    size_t start = columns.size();
+    size_t pos = 0;
+    size_t end = len;
+
+    // Die angefangene Zeile aus dem vorigen Block fertig machen.
+    if (lineLength_ > 0)
+    {
+      const void *lineEndPtr = std::memchr(dataPtr, '\n', len);
+      size_t part = lineEndPtr ? static_cast<const uint8_t *>(lineEndPtr) - dataPtr : len;
+      appendToLine(dataPtr, part);
+      if (!lineEndPtr) return 0;
+      pos = part + 1;
+      finishLine(columns);
+    }
+
+    // Nur bis zum letzten LF decodieren, der Rest wird aufgehoben.
+    while (end > pos && dataPtr[end - 1] != '\n') end--;
+    if (end > pos)
+    {
+      size_t size = columns.size();
+      columns.resize(size + (end - pos + 1) / BASE64_FRAME_LENGTH);
+      size_t count = decodeBase64Block(dataPtr + pos, end - pos, writerAt(columns, size), stats_);
+      columns.resize(size + count);
+    }
+    appendToLine(dataPtr + end, len - end);
+    return columns.size() - start;
+  }
+
+  const DecoderStats &stats() const { return stats_; }
+
+private:
+  static ColumnWriter writerAt(SampleColumns &columns, size_t index)
+  {
+    return ColumnWriter{columns.timecode.data() + index, columns.ref.data() + index,
+                        columns.ch1.data() + index, columns.ch2.data() + index,
+                        columns.ch3.data() + index};
+  }
+
+  // Es werden nur so viele Zeichen gespeichert, wie eine Nachricht hat, der Rest wird gleich
+  // als verworfen gezhlt (wie im Base64FrameDecoder).
+  void appendToLine(const uint8_t *dataPtr, size_t len)
+  {
+    size_t room = lineLength_ < BASE64_FRAME_LENGTH ? BASE64_FRAME_LENGTH - lineLength_ : 0;
+    if (room) std::memcpy(line_ + lineLength_, dataPtr, std::min(room, len));
+    if (len > room) stats_.skippedBytes += len - room;
+    lineLength_ += len;
+  }
+
+  void finishLine(SampleColumns &columns)
+  {
+    if (lineLength_ <= BASE64_FRAME_LENGTH)
+    {
+      size_t size = columns.size();
+      line_[lineLength_] = '\n';
+      columns.resize(size + 1);
+      columns.resize(size + decodeBase64Block(line_, lineLength_ + 1, writerAt(columns, size),
+                                              stats_));
+    }
+    else
+    {
+      stats_.corrupted++;
+    }
+    lineLength_ = 0;
+  }
+
+  uint8_t line_[BASE64_FRAME_LENGTH + 1];
+  size_t lineLength_ = 0;         // Lnge der angefangenen Zeile, kann grer als line_ sein.
+  DecoderStats stats_;
+};
+
+}  // namespace crashwagerl
+
+#endif /* CRASHWAGERLBULKDECODER_H_ */
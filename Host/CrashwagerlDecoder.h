@@ -0,0 +1,498 @@
+/*
+****************************************************************************************************
+CRASHWAGERLDECODER.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Decoder fr den Empfnger am PC (C++17). Wandelt die vom Crashwagerl gesendeten Bytes in
+       Messwerte um. Alle Nachrichtenformate (FRAME_FORMAT_BASE64, FRAME_FORMAT_BINARY und
+       FRAME_FORMAT_DELTA) werden untersttzt. Die Bytes knnen in beliebig groen Blcken
+       bergeben werden, wie sie von der seriellen Schnittstelle kommen.
+****************************************************************************************************
+*/
+
+#ifndef CRASHWAGERLDECODER_H_
+#define CRASHWAGERLDECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "../Crashwagerl/FrameFormat.h"
+
+namespace crashwagerl
+{
+
+// Ein decodierter Messwert. Der Timecode hat 24 Bit, wie er vom Crashwagerl gesendet wird.
+struct Sample
+{
+  uint32_t timecode;
+  uint16_t ref;         // Wert der 1.1V Referenz, im Binrformat 0 bis das erste Slow Word da ist.
+  uint16_t ch1;
+  uint16_t ch2;
+  uint16_t ch3;
+  uint8_t channels = CHANNEL_ALL;   // Enthaltene Kanle (Bit 0 = Ch1), die anderen sind 0.
+};
+
+// Zhler fr die Qualitt des Datenstroms.
+struct DecoderStats
+{
+  uint64_t frames = 0;         // Gltige Nachrichten
+  uint64_t corrupted = 0;      // Nachrichten mit falschem CRC, falscher Lnge, ungltigem Zeichen
+  uint64_t skippedBytes = 0;   // Beim Suchen des Nachrichtenanfangs verworfene Bytes
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert einen base64 String im Format des Crashwagerl (s. base64Decode in Crashwagerl.h).
+* @param bufferPtr: Pointer auf den Puffer, der den String beinhaltet.
+* @param len: Anzahl der Zeichen, die aus dem buffer gelesen werden sollen (max. 5).
+* @return Decodierter Wert oder -1, wenn ungltige Zeichen enthalten sind.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline int32_t base64Decode(const char *bufferPtr, uint8_t len)
+{
+  int32_t val = 0;
+  while (len--)
+  {
+    char c = *bufferPtr++;
+    if      (c >= 'A' && c <= 'Z') val = val*64 + (c - 'A');
+    else if (c >= 'a' && c <= 'z') val = val*64 + (c - 'a' + 26);
+    else if (c >= '0' && c <= '9') val = val*64 + (c - '0' + 52);
+    else if (c == '+')             val = val*64 + 62;
+    else if (c == '/')             val = val*64 + 63;
+    else return -1;
+  }
+  return val;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decoder fr das base64 Format (12 Zeichen + CR LF). Eine Nachricht beginnt nach jedem LF.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class Base64FrameDecoder
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Verarbeitet die bergebenen Bytes und ruft fr jede gltige Nachricht onSample auf.
+  * @param dataPtr: Empfangene Bytes.
+  * @param len: Anzahl der Bytes.
+  * @param onSample: Funktion mit dem Parameter const Sample &.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  void feed(const uint8_t *dataPtr, size_t len, Callback &&onSample)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      char c = static_cast<char>(dataPtr[i]);
+      if (c == '\n')
+      {
+        if (lineLength_ == 13 && line_[12] == '\r') decodeLine(onSample);
+        else if (lineLength_ > 0) stats_.corrupted++;
+        lineLength_ = 0;
+      }
+      else if (lineLength_ < sizeof(line_))
+      {
+        line_[lineLength_++] = c;
+      }
+      else
+      {
+        stats_.skippedBytes++;      // Zeile zu lang, wird beim LF als ungltig gezhlt.
+      }
+    }
+  }
+
+  const DecoderStats &stats() const { return stats_; }
+
+  // Jede Nachricht enthlt den vollen Timecode.
+  bool timecodeValid() const { return true; }
+
+  // Das base64 Format hat keinen Kanalplan, es werden immer alle Kanle gesendet.
+  uint8_t planCode() const { return 0; }
+
+private:
+  template <class Callback>
+  void decodeLine(Callback &&onSample)
+  {
+    int32_t time = base64Decode(line_, 4);
+    int32_t ref  = base64Decode(line_ + 4, 2);
+    int32_t ch1  = base64Decode(line_ + 6, 2);
+    int32_t ch2  = base64Decode(line_ + 8, 2);
+    int32_t ch3  = base64Decode(line_ + 10, 2);
+    if ((time | ref | ch1 | ch2 | ch3) < 0)
+    {
+      stats_.corrupted++;
+      return;
+    }
+    stats_.frames++;
+    onSample(Sample{static_cast<uint32_t>(time), static_cast<uint16_t>(ref),
+                    static_cast<uint16_t>(ch1), static_cast<uint16_t>(ch2),
+                    static_cast<uint16_t>(ch3)});
+  }
+
+  char line_[14];
+  size_t lineLength_ = 0;
+  DecoderStats stats_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decoder fr das binre Format (s. FrameFormat.h). Sucht das Sync Byte, prft den CRC und setzt
+* aus den Slow Word Bits den vollen Timecode und den Referenzwert zusammen. Bis das erste Slow
+* Word oder die Prambel empfangen wurde, zhlen Bit 8..23 des Timecodes ab 0. Nachrichten mit
+* Kanalplan werden am Sync Byte erkannt und haben je nach Kanlen 5 - 7 Bytes. Falsche Sync Bytes
+* verwirft der CRC.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BinaryFrameDecoder
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Verarbeitet die bergebenen Bytes und ruft fr jede gltige Nachricht onSample auf.
+  * @param dataPtr: Empfangene Bytes.
+  * @param len: Anzahl der Bytes.
+  * @param onSample: Funktion mit dem Parameter const Sample &.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  void feed(const uint8_t *dataPtr, size_t len, Callback &&onSample)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      if (fill_ == 0)
+      {
+        frameLength_ = frameLength(dataPtr[i]);
+        if (!frameLength_)
+        {
+          stats_.skippedBytes++;
+          continue;
+        }
+      }
+      frame_[fill_++] = dataPtr[i];
+      // Nach resync() kann der Puffer schon eine krzere Nachricht enthalten.
+      while (fill_ > 0 && fill_ >= frameLength_)
+      {
+        if (!crcValid())                          resync();
+        else if (frame_[0] == BINARY_PREAMBLE_SYNC) decodePreamble();
+        else                                      decodeFrame(onSample);
+      }
+    }
+  }
+
+  const DecoderStats &stats() const { return stats_; }
+
+  // Bit 8..23 des Timecodes sind erst nach der Prambel oder dem ersten vollstndigen Slow Word
+  // gltig.
+  bool timecodeValid() const { return timeValid_; }
+
+  // Kanalplan aus dem letzten Slow Word (s. planDivider in FrameFormat.h), 0 = alle Kanle bei
+  // jeder Messung. Gltig, sobald timecodeValid() true ist.
+  uint8_t planCode() const { return planCode_; }
+
+private:
+  bool crcValid() const
+  {
+    uint8_t crc = 0;
+    for (size_t i = 1; i < frameLength_ - 1; i++) crc = crc8Update(crc, frame_[i]);
+    return crc == frame_[frameLength_ - 1];
+  }
+
+  static size_t frameLength(uint8_t sync) { return binaryFrameLength(sync); }
+
+  // Der CRC stimmt nicht, das Sync Byte war also keines. Ab dem nchsten Sync Byte im Puffer wird
+  // weitergesucht.
+  void resync()
+  {
+    stats_.corrupted++;
+    stats_.skippedBytes++;
+    consume(1);
+  }
+
+  // Entfernt count Bytes am Anfang des Puffers und verwirft danach alles bis zum nchsten Sync
+  // Byte.
+  void consume(size_t count)
+  {
+    while (count < fill_ && !frameLength(frame_[count]))
+    {
+      count++;
+      stats_.skippedBytes++;
+    }
+    fill_ -= count;
+    std::memmove(frame_, frame_ + count, fill_);
+    if (fill_) frameLength_ = frameLength(frame_[0]);
+  }
+
+  // Die Prambel enthlt das ganze Slow Word der folgenden Nachricht. Deren Timecode wird nicht
+  // mit der vorigen Nachricht verglichen, im BURST_MODE beginnt er wieder bei 0.
+  void decodePreamble()
+  {
+    uint32_t word = 0;
+    for (size_t i = 1; i < BINARY_PREAMBLE_LENGTH - 1; i++) word = (word << 8) | frame_[i];
+    timeHigh_ = word >> 16;
+    ref_ = (word >> 6) & 0x3FF;
+    planCode_ = word & 0x3F;
+    timeValid_ = true;
+    hasLast_ = false;
+    slowCount_ = 0xFF;
+    consume(BINARY_PREAMBLE_LENGTH);
+  }
+
+  template <class Callback>
+  void decodeFrame(Callback &&onSample)
+  {
+    uint8_t timeLow = frame_[1];
+    uint8_t position = timeLow & (BINARY_SLOW_FRAMES - 1);
+    bool consecutive = hasLast_ && timeLow == static_cast<uint8_t>(lastTimeLow_ + 1);
+    bool repeated = hasLast_ && timeLow == lastTimeLow_;
+    bool full = frame_[0] == BINARY_FRAME_SYNC;
+
+    // berlauf der unteren 8 Bit. Es drfen also nicht mehr als 255 Nachrichten fehlen. Eine
+    // doppelte Nachricht hat denselben Timecode und ist kein berlauf, der StreamReceiver
+    // verwirft sie.
+    if (hasLast_ && timeLow < lastTimeLow_) timeHigh_ = (timeHigh_ + 1) & 0xFFFF;
+
+    // Die Werte stehen linksbndig ab Byte 2, danach folgen die 2 Slow Word Bits.
+    uint8_t channels = full ? CHANNEL_ALL : frame_[0] & CHANNEL_ALL;
+    uint32_t bits = 0;
+    for (size_t i = 2; i < 6; i++)
+    {
+      bits = (bits << 8) | (i < frameLength_ - 1u ? frame_[i] : 0);
+    }
+    uint16_t values[3] = {0, 0, 0};
+    for (size_t ch = 0; ch < 3; ch++)
+    {
+      if (!(channels & (1 << ch))) continue;
+      values[ch] = static_cast<uint16_t>(bits >> 22);
+      bits <<= 10;
+    }
+
+    // Slow Word zusammensetzen. Es gilt nur, wenn alle 16 Nachrichten lckenlos da sind, die Bits
+    // einer doppelten Nachricht sind schon enthalten.
+    uint8_t slowBits = static_cast<uint8_t>(bits >> 30);
+    if (position == 0 && !repeated)
+    {
+      slowWord_ = slowBits;
+      slowCount_ = 1;
+    }
+    else if (consecutive && slowCount_ == position)
+    {
+      slowWord_ = (slowWord_ << 2) | slowBits;
+      slowCount_++;
+    }
+    else if (!repeated)
+    {
+      slowCount_ = 0xFF;
+    }
+    if (slowCount_ == BINARY_SLOW_FRAMES)
+    {
+      timeHigh_ = slowWord_ >> 16;
+      ref_ = (slowWord_ >> 6) & 0x3FF;
+      planCode_ = slowWord_ & 0x3F;
+      timeValid_ = true;
+    }
+
+    Sample sample;
+    sample.timecode = (static_cast<uint32_t>(timeHigh_) << 8) | timeLow;
+    sample.ref = ref_;
+    sample.ch1 = values[0];
+    sample.ch2 = values[1];
+    sample.ch3 = values[2];
+    sample.channels = channels;
+
+    lastTimeLow_ = timeLow;
+    hasLast_ = true;
+    consume(frameLength_);
+    stats_.frames++;
+    onSample(sample);
+  }
+
+  uint8_t frame_[BINARY_FRAME_LENGTH];
+  size_t fill_ = 0;
+  size_t frameLength_ = 0;         // Lnge der Nachricht im Puffer laut Sync Byte
+  uint8_t lastTimeLow_ = 0;
+  bool hasLast_ = false;
+  uint32_t slowWord_ = 0;
+  uint8_t slowCount_ = 0xFF;       // Anzahl der gesammelten Slow Word Teile, 0xFF = ungltig
+  uint16_t timeHigh_ = 0;
+  uint16_t ref_ = 0;
+  uint8_t planCode_ = 0;
+  bool timeValid_ = false;
+  DecoderStats stats_;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decoder fr das Deltaformat (s. FrameFormat.h). Die Messwerte eines Segments (Keyframe und die
+* folgenden Deltaframes) werden erst ausgegeben, wenn der nchste Keyframe den Delta CRC besttigt.
+* Ist ein Segment fehlerhaft, wird es verworfen und ab dem nchsten Keyframe weiter decodiert.
+* Das letzte Segment einer Aufzeichnung wird daher nie ausgegeben.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class DeltaFrameDecoder
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Verarbeitet die bergebenen Bytes und ruft fr jeden besttigten Messwert onSample auf.
+  * @param dataPtr: Empfangene Bytes.
+  * @param len: Anzahl der Bytes.
+  * @param onSample: Funktion mit dem Parameter const Sample &.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  void feed(const uint8_t *dataPtr, size_t len, Callback &&onSample)
+  {
+    for (size_t i = 0; i < len; i++)
+    {
+      uint8_t val = dataPtr[i];
+      if (state_ == State::Delta)
+      {
+        if (fill_ == 0) need_ = (val >> 6) + 1;
+        frame_[fill_++] = val;
+        segmentCrc_ = crc8Update(segmentCrc_, val);
+        if (fill_ == need_) decodeDelta();
+        continue;
+      }
+      // Suche und Keyframe: Der Keyframe muss mit dem Sync Byte beginnen.
+      if (fill_ == 0 && val != DELTA_KEYFRAME_SYNC)
+      {
+        stats_.skippedBytes++;
+        if (state_ == State::Key) dropSegment();
+        continue;
+      }
+      frame_[fill_++] = val;
+      if (fill_ == DELTA_KEYFRAME_LENGTH) decodeKeyFrame(onSample);
+    }
+  }
+
+  const DecoderStats &stats() const { return stats_; }
+
+  // Jeder Keyframe enthlt den vollen Timecode.
+  bool timecodeValid() const { return true; }
+
+  // Das Deltaformat hat keinen Kanalplan.
+  uint8_t planCode() const { return 0; }
+
+private:
+  enum class State { Search, Delta, Key };
+
+  bool keyFrameCrcValid() const
+  {
+    uint8_t crc = 0;
+    for (size_t i = 1; i < DELTA_KEYFRAME_LENGTH - 1; i++) crc = crc8Update(crc, frame_[i]);
+    return crc == frame_[DELTA_KEYFRAME_LENGTH - 1];
+  }
+
+  void dropSegment()
+  {
+    stats_.corrupted += segmentLength_;
+    segmentLength_ = 0;
+    state_ = State::Search;
+  }
+
+  template <class Callback>
+  void decodeKeyFrame(Callback &&onSample)
+  {
+    if (!keyFrameCrcValid())
+    {
+      // Kein gltiger Keyframe. Ab dem nchsten Sync Byte im Puffer wird weitergesucht.
+      size_t start = 1;
+      if (state_ == State::Key) dropSegment();
+      else stats_.corrupted++;
+      while (start < DELTA_KEYFRAME_LENGTH && frame_[start] != DELTA_KEYFRAME_SYNC) start++;
+      stats_.skippedBytes += start;
+      fill_ = DELTA_KEYFRAME_LENGTH - start;
+      std::memmove(frame_, frame_ + start, fill_);
+      return;
+    }
+
+    Sample key;
+    key.timecode = (static_cast<uint32_t>(frame_[1]) << 16) | (frame_[2] << 8) | frame_[3];
+    key.ref = static_cast<uint16_t>((frame_[4] << 2) | (frame_[5] >> 6));
+    key.ch1 = static_cast<uint16_t>(((frame_[5] & 0x3F) << 4) | (frame_[6] >> 4));
+    key.ch2 = static_cast<uint16_t>(((frame_[6] & 0x0F) << 6) | (frame_[7] >> 2));
+    key.ch3 = static_cast<uint16_t>(((frame_[7] & 0x03) << 8) | frame_[8]);
+
+    // Das vorige Segment ist nur gltig, wenn der Delta CRC und der Timecode passen.
+    if (state_ == State::Key)
+    {
+      if (frame_[9] == segmentCrc_ && key.timecode == ((last_.timecode + 1) & 0xFFFFFF))
+      {
+        for (size_t i = 0; i < segmentLength_; i++) onSample(segment_[i]);
+        stats_.frames += segmentLength_;
+        segmentLength_ = 0;
+      }
+      else
+      {
+        dropSegment();
+      }
+    }
+
+    // Neues Segment mit dem Keyframe beginnen.
+    segment_[0] = key;
+    segmentLength_ = 1;
+    segmentCrc_ = 0;
+    last_ = key;
+    fill_ = 0;
+    state_ = nextState();
+  }
+
+  void decodeDelta()
+  {
+    uint32_t bits = 0;
+    for (size_t i = 0; i < 4; i++) bits = (bits << 8) | (i < fill_ ? frame_[i] : 0);
+
+    Sample sample = last_;
+    sample.timecode = (last_.timecode + 1) & 0xFFFFFF;
+    uint8_t code = static_cast<uint8_t>(bits >> 30);
+    if (code == 0b11)
+    {
+      sample.ch1 = (bits >> 20) & 0x3FF;
+      sample.ch2 = (bits >> 10) & 0x3FF;
+      sample.ch3 = bits & 0x3FF;
+    }
+    else
+    {
+      int width = 2 * (code + 1);
+      sample.ch1 = static_cast<uint16_t>(last_.ch1 + signedField(bits, 30 - width, width));
+      sample.ch2 = static_cast<uint16_t>(last_.ch2 + signedField(bits, 30 - 2 * width, width));
+      sample.ch3 = static_cast<uint16_t>(last_.ch3 + signedField(bits, 30 - 3 * width, width));
+    }
+
+    segment_[segmentLength_++] = sample;
+    last_ = sample;
+    fill_ = 0;
+    state_ = nextState();
+  }
+
+  // Liefert das Feld mit der Breite width ab Bit shift als Zahl mit Vorzeichen.
+  static int32_t signedField(uint32_t bits, int shift, int width)
+  {
+    int32_t val = static_cast<int32_t>((bits >> shift) & ((1u << width) - 1));
+    if (val & (1 << (width - 1))) val -= (1 << width);
+    return val;
+  }
+
+  // Ist der Timecode der nchsten Nachricht ein Vielfaches des Intervalls, kommt ein Keyframe.
+  State nextState() const
+  {
+    return ((last_.timecode + 1) & (DELTA_KEYFRAME_INTERVAL - 1)) ? State::Delta : State::Key;
+  }
+
+  uint8_t frame_[DELTA_KEYFRAME_LENGTH];
+  size_t fill_ = 0;
+  size_t need_ = 0;
+  State state_ = State::Search;
+  Sample segment_[DELTA_KEYFRAME_INTERVAL];
+  size_t segmentLength_ = 0;
+  uint8_t segmentCrc_ = 0;
+  Sample last_ = {};
+  DecoderStats stats_;
+};
+
+}  // namespace crashwagerl
+
+#endif /* CRASHWAGERLDECODER_H_ */
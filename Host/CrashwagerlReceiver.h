@@ -0,0 +1,178 @@
+/*
+****************************************************************************************************
+CRASHWAGERLRECEIVER.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Empfnger fr den Datenstrom des Crashwagerl (C++17). Baut auf den Decodern in
+       CrashwagerlDecoder.h auf, die nach einem verlorenen Byte am nchsten Zeilenende bzw. Sync
+       Byte wieder aufsetzen und ungltige Zeichen verwerfen. Der Empfnger
+         - setzt den 24 Bit Timecode (luft nach 4 h 40 min ber) zu einer 64 Bit Zeit fort,
+           die immer steigt,
+         - zhlt fehlende, doppelte bzw. versptete Nachrichten und Neustarts des Crashwagerl,
+         - stellt die Zhler als Live Statistik zur Verfgung, die von einem anderen Thread
+           gelesen werden kann.
+       Der Speicherbedarf ist konstant, es werden keine Nachrichten zwischengespeichert.
+****************************************************************************************************
+*/
+
+#ifndef CRASHWAGERLRECEIVER_H_
+#define CRASHWAGERLRECEIVER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "CrashwagerlDecoder.h"
+
+namespace crashwagerl
+{
+
+// Ein Messwert mit fortlaufender Zeit (1 Einheit = 1 Messung, bei 1000 Hz also 1 ms).
+struct TimedSample
+{
+  uint64_t time;
+  uint16_t ref;
+  uint16_t ch1;
+  uint16_t ch2;
+  uint16_t ch3;
+  uint8_t channels;     // Enthaltene Kanle (Bit 0 = Ch1), s. Kanalplan in FrameFormat.h
+};
+
+// Zhler des Empfngers.
+struct ReceiverStats
+{
+  uint64_t frames = 0;         // Ausgegebene Messwerte
+  uint64_t corrupted = 0;      // Nachrichten mit falschem CRC, falscher Lnge, ungltigem Zeichen
+  uint64_t skippedBytes = 0;   // Beim Suchen des Nachrichtenanfangs verworfene Bytes
+  uint64_t dropped = 0;        // Fehlende Nachrichten (Lcken im Timecode)
+  uint64_t duplicated = 0;     // Nachrichten mit dem Timecode einer der beiden vorigen
+  uint64_t restarts = 0;       // Sprnge zurck oder auf 0: Neustart oder neuer Burst
+};
+
+// Der Timecode des Crashwagerl hat 24 Bit.
+constexpr uint32_t TIMECODE_MASK = 0xFFFFFF;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Empfnger fr ein Nachrichtenformat.
+* @tparam Decoder: Base64FrameDecoder, BinaryFrameDecoder oder DeltaFrameDecoder.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+class StreamReceiver
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Verarbeitet die bergebenen Bytes und ruft fr jeden neuen Messwert onSample auf. Die
+  * Messwerte kommen in aufsteigender Zeit. Danach werden die Live Zhler aktualisiert.
+  * @param dataPtr: Empfangene Bytes.
+  * @param len: Anzahl der Bytes.
+  * @param onSample: Funktion mit dem Parameter const TimedSample &.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  void feed(const uint8_t *dataPtr, size_t len, Callback &&onSample)
+  {
+    decoder_.feed(dataPtr, len, [&](const Sample &sample) { receive(sample, onSample); });
+    publish();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Liefert die Zhler mit dem Stand nach dem letzten feed(). Darf aus jedem Thread aufgerufen
+  * werden, die einzelnen Zhler knnen dabei von unterschiedlichen feed() Aufrufen stammen.
+  * @return Zhler.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  ReceiverStats stats() const
+  {
+    ReceiverStats stats;
+    stats.frames = live_.frames.load(std::memory_order_relaxed);
+    stats.corrupted = live_.corrupted.load(std::memory_order_relaxed);
+    stats.skippedBytes = live_.skippedBytes.load(std::memory_order_relaxed);
+    stats.dropped = live_.dropped.load(std::memory_order_relaxed);
+    stats.duplicated = live_.duplicated.load(std::memory_order_relaxed);
+    stats.restarts = live_.restarts.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  // Kanalplan des Datenstroms (s. planDivider in FrameFormat.h). Nur im Thread von feed() aufrufen.
+  uint8_t planCode() const { return decoder_.planCode(); }
+
+private:
+  template <class Callback>
+  void receive(const Sample &sample, Callback &&onSample)
+  {
+    // Im Binrformat ist der Timecode erst nach dem ersten Slow Word vollstndig.
+    if (!decoder_.timecodeValid()) return;
+
+    if (!hasTime_)
+    {
+      time_ = sample.timecode;
+      hasTime_ = true;
+    }
+    else
+    {
+      uint32_t step = (sample.timecode - lastTimecode_) & TIMECODE_MASK;
+      if (step == 0 || sample.timecode == previousTimecode_)
+      {
+        // Die letzte oder vorletzte Nachricht wurde wiederholt.
+        duplicated_++;
+        return;
+      }
+      if (step > (TIMECODE_MASK >> 1) || (sample.timecode == 0 && step != 1))
+      {
+        // Zurck oder auf 0 (auer beim berlauf): Der Crashwagerl zhlt nach einem Neustart
+        // bzw. im BURST_MODE bei jedem Burst wieder ab 0. Die Zeit luft weiter.
+        restarts_++;
+        step = 1;
+      }
+      else
+      {
+        dropped_ += step - 1;
+      }
+      time_ += step;
+    }
+    previousTimecode_ = lastTimecode_;
+    lastTimecode_ = sample.timecode;
+    frames_++;
+    onSample(TimedSample{time_, sample.ref, sample.ch1, sample.ch2, sample.ch3, sample.channels});
+  }
+
+  void publish()
+  {
+    const DecoderStats &decoderStats = decoder_.stats();
+    live_.frames.store(frames_, std::memory_order_relaxed);
+    live_.corrupted.store(decoderStats.corrupted, std::memory_order_relaxed);
+    live_.skippedBytes.store(decoderStats.skippedBytes, std::memory_order_relaxed);
+    live_.dropped.store(dropped_, std::memory_order_relaxed);
+    live_.duplicated.store(duplicated_, std::memory_order_relaxed);
+    live_.restarts.store(restarts_, std::memory_order_relaxed);
+  }
+
+  struct LiveStats
+  {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> corrupted{0};
+    std::atomic<uint64_t> skippedBytes{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> duplicated{0};
+    std::atomic<uint64_t> restarts{0};
+  };
+
+  Decoder decoder_;
+  uint64_t time_ = 0;
+  uint32_t lastTimecode_ = ~0u;
+  uint32_t previousTimecode_ = ~0u;   // ~0: Noch keine Nachricht
+  bool hasTime_ = false;
+  uint64_t frames_ = 0;
+  uint64_t dropped_ = 0;
+  uint64_t duplicated_ = 0;
+  uint64_t restarts_ = 0;
+  LiveStats live_;
+};
+
+}  // namespace crashwagerl
+
+#endif /* CRASHWAGERLRECEIVER_H_ */
@@ -0,0 +1,205 @@
+/*
+****************************************************************************************************
+HOSTBACKEND.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Mock Backend fr die bersetzung der Firmware am PC (s. Crashwagerl/Hal.h). Statt der
+       Register gibt es:
+       - Einen AD Wandler, der fr jede Messung synthetische Werte erzeugt (konstant, Rampe,
+         Sinus oder Rauschen). berabtastung, Kanalplan und REF_TRACKING werden wie in
+         AdcScheduler.h nachgebildet, die Werte haben also ADC_RESULT_BITS.
+       - Ein USI, das jedes Byte wie uartStartByte und die USI ISR in 2 Teilen aus dem
+         Schieberegister schiebt. Die Pegel am Pin werden als 8N2 decodiert und die Bytes in
+         hostCapture geschrieben, fehlerhafte Start- oder Stoppbits werden gezhlt.
+       Nach hostSamplesLeft Messungen springt waitForAdcFrame mit longjmp zu hostExit zurck,
+       damit die Endlosschleife in main() beendet wird (s. crashsim.c).
+       Nur am PC einbinden, nach Crashwagerl.h.
+****************************************************************************************************
+*/
+
+#ifndef HOSTBACKEND_H_
+#define HOSTBACKEND_H_
+
+#include <math.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __AVR__
+#error "HostBackend.h ist nur fr die bersetzung am PC"
+#endif
+
+// Was main() sonst aus den AVR Headern verwendet.
+enum {PB0, PB1, PB2, PB3, PB4, PB5};
+static volatile uint8_t DDRB;
+static volatile uint8_t GPIOR0;          // Fr PROFILE_STAGES, wird nur geschrieben.
+static volatile uint8_t GPIOR1;
+#define sei()
+#define cli()
+#define DELAY_US(val)
+
+#include "../Crashwagerl/Profiling.h"
+
+typedef enum {HOST_SIGNAL_CONST, HOST_SIGNAL_RAMP, HOST_SIGNAL_SINE,
+              HOST_SIGNAL_NOISE} HOST_SIGNALS;
+
+#define HOST_OVERSAMPLING   (1 << (2 * ADC_OVERSAMPLING_LOG4))
+#define HOST_REF_RAW        341      // 1.1 V bei 3.3 V Vcc als 10 Bit Wert
+
+static HOST_SIGNALS hostSignal = HOST_SIGNAL_SINE;
+static uint32_t hostSamplesLeft = 1000;  // Messungen bis zum longjmp
+static jmp_buf hostExit;
+static uint32_t hostTick;                // Messungen seit initAdcScheduler
+static uint32_t hostNoise = 1;           // Zustand des Zufallsgenerators
+static uint8_t hostRefReady;
+
+static uint8_t *hostCapture;             // Vom USI gesendete Bytes
+static size_t hostCaptureLength;
+static size_t hostCaptureCapacity;
+static uint32_t hostFrameErrors;         // Bytes mit falschem Start- oder Stoppbit
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert eine Wandlung des synthetischen Signals.
+* @param channel: Kanal 0..2 (Ch1..Ch3).
+* @param tick: Nummer der Messung.
+* @return 10 Bit Wert.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint16_t hostConvert(uint8_t channel, uint32_t tick)
+{
+  int32_t value;
+
+  switch (hostSignal)
+  {
+    case HOST_SIGNAL_RAMP:
+      value = (int32_t)((tick * (channel + 1)) & 0x3FF);
+      break;
+    case HOST_SIGNAL_SINE:
+      value = 512 + (int32_t)lround(400.0 * sin(2.0 * M_PI * (channel + 1) * tick / 1000.0));
+      break;
+    case HOST_SIGNAL_NOISE:
+      hostNoise = hostNoise * 1103515245u + 12345u;
+      value = 512 + (int32_t)((hostNoise >> 16) & 0x0F) - 8;
+      break;
+    default:
+      value = 300 + 200 * channel;
+      break;
+  }
+  return (uint16_t)value;
+}
+
+static inline void initOscillator() {}
+static inline void initAdc() {}
+static inline void initUart() {}
+
+static inline uint16_t readAdcValue(ADC_CHANNELS channel)
+{
+  (void)channel;
+  return HOST_REF_RAW;                   // Wird nur fr die Referenz verwendet.
+}
+
+static inline void initAdcScheduler()
+{
+  hostTick = 0;
+  hostRefReady = 0;
+}
+
+static inline uint8_t hostChannelActive(uint8_t divider, uint32_t tick)
+{
+  return divider && !(tick & (divider - 1u));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liefert die nchste Messung wie AdcScheduler.h. Nach hostSamplesLeft Messungen wird mit longjmp
+* zu hostExit gesprungen.
+* @param valuesPtr: Ch1..Ch3, nicht gewandelte Kanle bleiben unverndert.
+* @return Maske der gewandelten Kanle.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline uint8_t waitForAdcFrame(uint16_t *valuesPtr)
+{
+  static const uint8_t dividers[3] = {CH1_DIVIDER, CH2_DIVIDER, CH3_DIVIDER};
+  uint8_t channels = 0;
+  uint8_t channel;
+  uint8_t count;
+
+  if (!hostSamplesLeft) longjmp(hostExit, 1);
+  hostSamplesLeft--;
+  for (channel = 0; channel < 3; channel++)
+  {
+    uint32_t sum = 0;
+    if (!hostChannelActive(dividers[channel], hostTick)) continue;
+    for (count = 0; count < HOST_OVERSAMPLING; count++) sum += hostConvert(channel, hostTick);
+    valuesPtr[channel] = (uint16_t)((sum + ADC_RESULT_ROUND) >> ADC_RESULT_SHIFT);
+    channels |= 1 << channel;
+  }
+  hostTick++;
+  if (!(hostTick & 15)) hostRefReady = 1;   // ADC_REF_AVERAGE Intervalle
+  return channels;
+}
+
+static inline uint8_t readAdcRef(uint16_t *refPtr)
+{
+  if (!hostRefReady) return 0;
+  hostRefReady = 0;
+  *refPtr = HOST_REF_RAW << (ADC_RESULT_BITS - 10);
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schiebt ein umgedrehtes Byte wie am Chip aus dem USIDR und decodiert die Pegel am Pin. Der 1.
+* Teil (0 D0 .. D6) liegt 5 Bitzeiten an (Start, D0 .. D3), dann ldt die ISR den 2. Teil
+* (D4 .. D7 1 1 1 1) fr 6 Bitzeiten (D4 .. D7 und 2 Stoppbits).
+* @param reversedByte: Byte aus dem TxBuffer.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void hostUsiShiftOut(uint8_t reversedByte)
+{
+  uint8_t firstHalf = reversedByte >> 1;
+  uint8_t secondHalf = (uint8_t)(reversedByte << 4) | 0b1111;
+  uint16_t levels = 0;                   // Bit 10 = Startbit, Bit 0 = 2. Stoppbit
+  uint8_t value = 0;
+  uint8_t count;
+
+  for (count = 0; count < 5; count++) levels = (levels << 1) | ((firstHalf >> (7 - count)) & 1);
+  for (count = 0; count < 6; count++) levels = (levels << 1) | ((secondHalf >> (7 - count)) & 1);
+
+  if ((levels & 0x403) != 0x003) hostFrameErrors++;   // Start 0, 2 Stoppbits 1
+  for (count = 0; count < 8; count++) value |= ((levels >> (9 - count)) & 1) << count;
+
+  if (hostCaptureLength == hostCaptureCapacity)
+  {
+    hostCaptureCapacity = hostCaptureCapacity ? 2 * hostCaptureCapacity : 65536;
+    hostCapture = (uint8_t *)realloc(hostCapture, hostCaptureCapacity);
+    if (!hostCapture)
+    {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  hostCapture[hostCaptureLength++] = value;
+}
+
+static inline void uartSendBytes(const uint8_t *dataPtr, uint8_t len)
+{
+  while (len--) hostUsiShiftOut(reverseByte(*dataPtr++));
+}
+
+static inline void uartSendReversedBytes(const uint8_t *dataPtr, uint8_t len)
+{
+  while (len--) hostUsiShiftOut(*dataPtr++);
+}
+
+static inline void uartSendMessage(const char *messagePtr)
+{
+  while (*messagePtr) hostUsiShiftOut(reverseByte((uint8_t)*messagePtr++));
+}
+
+static inline void uartFlush() {}
+
+#endif /* HOSTBACKEND_H_ */
@@ -0,0 +1,550 @@
+/*
+****************************************************************************************************
+MERGEENGINE.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Fhrt die Aufzeichnungen (CaptureFile.h) mehrerer gleichzeitig laufender Crashwagerl auf
+       eine gemeinsame Zeitachse zusammen (POSIX, C++17). Jeder Crashwagerl zhlt die Zeit ab
+       seinem Einschalten mit seinem eigenen, per OSCCAL kalibrierten RC Oszillator. Offset und
+       Drift werden aus einem gemeinsamen Sync Puls bestimmt, der bei allen Crashwagerl auf
+       demselben Kanal aufgezeichnet wird (z. B. ein Rechtecksignal mit 1 Hz auf Ch3):
+         - Die steigenden Flanken werden mit Hysterese erkannt, der Zeitpunkt wird zwischen den
+           beiden Messungen um die Schwelle linear interpoliert.
+         - Die k-te Flanke ist bei allen Crashwagerl derselbe Zeitpunkt. Der Puls darf daher erst
+           anlaufen, wenn alle Crashwagerl messen.
+         - Zwischen 2 Flanken wird die Zeit jedes Crashwagerl linear auf die Zeit des ersten
+           (Referenz) umgerechnet. Offset und Drift drfen sich so mit der Temperatur ndern.
+       Die Zeilen der Referenz bilden die Zeitachse. Fr jede Zeile werden die Werte der anderen
+       Crashwagerl zum umgerechneten Zeitpunkt linear interpoliert. Dabei wird pro Kanal die
+       letzte Messung davor und die erste danach mit einem Wert genommen (Kanalplan). Liegen sie
+       mehr als MERGE_MAX_GAP Messungen auseinander (fehlende Nachrichten), bleibt der Wert leer.
+       Zeilen vor der ersten Flanke der Referenz werden verworfen, nach der letzten Flanke wird
+       mit dem letzten Abschnitt weitergerechnet. Das gilt auch fr einen Crashwagerl, dessen
+       Aufzeichnung frher endet oder dem Flanken fehlen. Bis er eine Flanke gemeinsam mit der
+       Referenz hat, bleiben seine Werte leer.
+
+       Pro Crashwagerl liest ein eigener Thread die Spalten, erkennt die Flanken und schreibt
+       Messungen und Flanken in einen Ringpuffer (SpscRing.h). Der aufrufende Thread holt sie ab
+       und rechnet um. Im Speicher liegen nur die Messungen eines Sync Abschnitts pro
+       Crashwagerl, unabhngig von der Lnge der Aufzeichnung. Kommt lnger als
+       MERGE_MAX_BUFFERED Messungen keine Flanke, wird abgebrochen.
+****************************************************************************************************
+*/
+
+#ifndef MERGEENGINE_H_
+#define MERGEENGINE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "SpscRing.h"
+
+namespace crashwagerl
+{
+
+constexpr size_t MERGE_RING_SIZE = 1 << 18;          // Bytes pro Crashwagerl
+constexpr size_t MERGE_BATCH = 1024;                 // Eintrge pro Schreibzugriff
+constexpr size_t MERGE_MAX_BUFFERED = 1 << 20;       // Messungen, bei 1 kHz rd. 17 min
+constexpr double MERGE_MAX_GAP = 4;                  // CHANNEL_PLAN_CYCLE
+constexpr size_t MERGE_PLAN_SEARCH = 4;              // Messungen pro Richtung bei der Kanalsuche
+constexpr double MERGE_EDGE_TOLERANCE = 0.01;        // Erlaubte Abweichung der Abschnittslnge
+
+// Eine Messung oder eine Flanke im Ringpuffer zwischen Lesethread und Merge.
+struct MergeItem
+{
+  double time;            // Zeit der Messung bzw. der Flanke in Messungen des Crashwagerl
+  uint16_t values[3];     // Ch1..Ch3
+  uint8_t channels;       // Enthaltene Kanle (Bit 0 = Ch1)
+  uint8_t edge;           // 1: Flanke des Sync Pulses, values ist dann ungltig
+};
+
+// Werte eines Crashwagerl in einer Zeile der gemeinsamen Zeitachse.
+struct MergedValues
+{
+  uint16_t values[3];
+  uint8_t channels;
+};
+
+// Ergebnis der Zeitschtzung fr einen Crashwagerl.
+struct BoardClock
+{
+  uint64_t edges = 0;         // Erkannte Flanken
+  uint64_t mismatched = 0;    // Abschnitte, deren Lnge nicht zur Referenz passt
+  double offset = 0;          // Zeit der ersten Flanke minus der Zeit bei der Referenz
+  double drift = 0;           // Gangabweichung zur Referenz ber alle Flanken (1e-6 = 1 ppm)
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erkennt die steigenden Flanken des Sync Pulses in einem Kanal.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SyncEdgeDetector
+{
+public:
+  SyncEdgeDetector(uint16_t threshold, uint16_t hysteresis)
+    : threshold_(threshold), hysteresis_(hysteresis) {}
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Nimmt eine Messung auf.
+  * @param time: Zeit der Messung.
+  * @param value: Wert im Sync Kanal.
+  * @param edgeTime: Zeitpunkt der Flanke, wenn eine erkannt wurde.
+  * @return true, wenn mit dieser Messung eine Flanke erkannt wurde.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool feed(double time, uint16_t value, double &edgeTime)
+  {
+    bool found = false;
+
+    if (hasLast_ && lastValue_ < threshold_ && value >= threshold_)
+    {
+      crossing_ = lastTime_ + (time - lastTime_) * (threshold_ - lastValue_) / (value - lastValue_);
+    }
+    if (value + hysteresis_ < threshold_)
+    {
+      armed_ = true;
+    }
+    else if (armed_ && value >= threshold_ + hysteresis_)
+    {
+      armed_ = false;
+      edgeTime = crossing_;
+      found = true;
+    }
+    lastTime_ = time;
+    lastValue_ = value;
+    hasLast_ = true;
+    return found;
+  }
+
+private:
+  double threshold_;
+  uint16_t hysteresis_;
+  bool armed_ = false;
+  bool hasLast_ = false;
+  double lastTime_ = 0;
+  double lastValue_ = 0;
+  double crossing_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Zusammenfhrung mehrerer Aufzeichnungen.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class MergeEngine
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * @param syncChannel: Kanal mit dem Sync Puls (0..2 fr Ch1..Ch3).
+  * @param threshold: Schwelle fr die Flanke.
+  * @param hysteresis: Hysterese um die Schwelle.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  MergeEngine(unsigned syncChannel, uint16_t threshold, uint16_t hysteresis)
+    : syncChannel_(syncChannel), threshold_(threshold), hysteresis_(hysteresis) {}
+
+  ~MergeEngine() { stop(); }
+
+  // Fgt eine Aufzeichnung hinzu, die erste ist die Referenz.
+  bool addBoard(const std::string &directory)
+  {
+    auto board = std::make_unique<Board>();
+    if (!board->time.open(directory + "/time.u64") || !board->ch1.open(directory + "/ch1.u16") ||
+        !board->ch2.open(directory + "/ch2.u16") || !board->ch3.open(directory + "/ch3.u16"))
+    {
+      return false;
+    }
+    boards_.push_back(std::move(board));
+    return true;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Startet die Lesethreads und ruft fr jede Zeile der Referenz onRow auf.
+  * @param onRow: Funktion mit den Parametern (double Zeit der Referenz, const MergedValues *
+  *               mit einem Eintrag pro Crashwagerl).
+  * @return false, wenn es keine oder zu lange keine Flanke gab.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  bool run(Callback &&onRow)
+  {
+    std::vector<MergedValues> row(boards_.size());
+    Board &ref = *boards_[0];
+    bool ok = true;
+
+    for (auto &board : boards_)
+    {
+      Board &b = *board;
+      b.reader = std::thread([this, &b]() { produce(b); });
+    }
+
+    while (ok && fill(ref, 1))
+    {
+      MergeItem sample = ref.samples.front();
+      ref.samples.pop_front();
+
+      // Fr den Abschnitt der Referenz muss die nchste Flanke bekannt sein.
+      if (!fillEdges(ref, segment_ + 2) && ref.samples.size() > MERGE_MAX_BUFFERED)
+      {
+        ok = false;
+        break;
+      }
+      if (!ref.edgeCount || sample.time < ref.firstEdge)
+      {
+        dropped_++;
+        continue;
+      }
+      while (knownEdges(ref) > segment_ + 1 && edgeAt(ref, segment_ + 1) <= sample.time)
+      {
+        segment_++;
+        checkSegment();
+      }
+      trimEdges();
+
+      row[0] = MergedValues{{sample.values[0], sample.values[1], sample.values[2]},
+                            sample.channels};
+      for (size_t b = 1; b < boards_.size(); b++)
+      {
+        Board &board = *boards_[b];
+        if (!fillEdges(board, segment_ + 2) && board.samples.size() > MERGE_MAX_BUFFERED)
+        {
+          ok = false;
+          break;
+        }
+        updateMapping(board);
+        row[b] = board.mapped ? interpolate(board, mapTime(board, sample.time))
+                              : MergedValues{{0, 0, 0}, 0};
+      }
+      if (ok) onRow(sample.time, row.data());
+    }
+    stop();
+    if (!ref.edgeCount) ok = false;
+    if (!ok)
+    {
+      fprintf(stderr, "Kein Sync Puls oder lnger als %zu Messungen keine Flanke\n",
+              MERGE_MAX_BUFFERED);
+    }
+    return ok;
+  }
+
+  size_t boards() const { return boards_.size(); }
+
+  // Zeilen der Referenz vor der ersten Flanke.
+  uint64_t dropped() const { return dropped_; }
+
+  // Offset und Drift eines Crashwagerl, erst nach run() gltig.
+  BoardClock clock(size_t board) const
+  {
+    const Board &b = *boards_[board];
+    const Board &ref = *boards_[0];
+    BoardClock clock;
+    clock.edges = b.edgeCount;
+    clock.mismatched = b.mismatched;
+    if (b.edgeCount && ref.edgeCount) clock.offset = b.firstEdge - ref.firstEdge;
+    if (board && b.lastCommonEdge > b.firstEdge)
+    {
+      clock.drift = (b.lastCommonEdge - b.firstEdge) / (b.lastReferenceEdge - ref.firstEdge) - 1;
+    }
+    return clock;
+  }
+
+private:
+  struct Board
+  {
+    ReadOnlyColumn<uint64_t> time;
+    ReadOnlyColumn<uint16_t> ch1, ch2, ch3;
+    SpscRing ring{MERGE_RING_SIZE};
+    std::atomic<bool> done{false};
+    std::thread reader;
+    bool ended = false;                // Ring leer und Lesethread fertig
+    std::deque<MergeItem> samples;     // Messungen ab der letzten vor dem aktuellen Zeitpunkt
+    std::deque<double> edges;          // Flanken ab edgeBase
+    uint64_t edgeBase = 0;             // Nummer der ersten Flanke in edges
+    uint64_t edgeCount = 0;
+    uint64_t mismatched = 0;
+    double firstEdge = 0;
+    double lastCommonEdge = 0;         // Letzte Flanke, die es auch bei der Referenz gibt
+    double lastReferenceEdge = 0;      // Dieselbe Flanke bei der Referenz
+    bool mapped = false;               // Umrechnung in die Zeit des Crashwagerl (s. mapTime)
+    double mapReference = 0;           // Flanke am Anfang des Abschnitts bei der Referenz
+    double mapStart = 0;               // Dieselbe Flanke beim Crashwagerl
+    double mapRatio = 1;               // Lnge des Abschnitts beim Crashwagerl / Referenz
+  };
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Lesethread: Spalten -> Flankenerkennung -> Ringpuffer. Wartet, wenn der Ringpuffer voll ist.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  void produce(Board &board)
+  {
+    SyncEdgeDetector detector(threshold_, hysteresis_);
+    const ReadOnlyColumn<uint16_t> *columns[3] = {&board.ch1, &board.ch2, &board.ch3};
+    MergeItem batch[MERGE_BATCH + 1];
+    size_t count = 0;
+
+    for (size_t row = 0; row < board.time.size() && !stopRequested_; row++)
+    {
+      MergeItem &item = batch[count++];
+      item.time = static_cast<double>(board.time[row]);
+      item.channels = 0;
+      item.edge = 0;
+      for (unsigned ch = 0; ch < 3; ch++)
+      {
+        item.values[ch] = (*columns[ch])[row];
+        if (item.values[ch] != CAPTURE_NO_VALUE) item.channels |= 1 << ch;
+      }
+      double edgeTime;
+      if ((item.channels & (1 << syncChannel_)) &&
+          detector.feed(item.time, item.values[syncChannel_], edgeTime))
+      {
+        batch[count++] = MergeItem{edgeTime, {0, 0, 0}, 0, 1};
+      }
+      if (count >= MERGE_BATCH) count = push(board, batch, count);
+    }
+    while (count && !stopRequested_) count = push(board, batch, count);
+    board.done = true;
+  }
+
+  // Schreibt die Eintrge in den Ringpuffer, sobald Platz ist. Liefert 0.
+  size_t push(Board &board, const MergeItem *items, size_t count)
+  {
+    size_t bytes = count * sizeof(MergeItem);
+    while (board.ring.capacity() - board.ring.size() < bytes)
+    {
+      if (stopRequested_) return 0;
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    board.ring.write(reinterpret_cast<const uint8_t *>(items), bytes);
+    return 0;
+  }
+
+  // Holt Eintrge aus dem Ringpuffer. Liefert false, wenn nichts mehr kommt.
+  bool pull(Board &board)
+  {
+    MergeItem items[MERGE_BATCH];
+
+    while (true)
+    {
+      bool done = board.done;
+      size_t len = board.ring.read(reinterpret_cast<uint8_t *>(items), sizeof(items));
+      for (size_t i = 0; i < len / sizeof(MergeItem); i++)
+      {
+        if (items[i].edge) addEdge(board, items[i].time);
+        else               board.samples.push_back(items[i]);
+      }
+      if (len) return true;
+      if (done)
+      {
+        board.ended = true;
+        return false;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  void addEdge(Board &board, double time)
+  {
+    if (!board.edgeCount) board.firstEdge = time;
+    board.edges.push_back(time);
+    board.edgeCount++;
+  }
+
+  // Liest, bis mindestens count Messungen da sind. Liefert false am Ende der Aufzeichnung.
+  bool fill(Board &board, size_t count)
+  {
+    while (board.samples.size() < count)
+    {
+      if (board.ended || !pull(board)) return board.samples.size() >= count;
+    }
+    return true;
+  }
+
+  // Liest, bis die Flanke mit der Nummer count - 1 bekannt ist oder die Aufzeichnung endet.
+  bool fillEdges(Board &board, uint64_t count)
+  {
+    while (board.edgeCount < count)
+    {
+      if (board.ended || board.samples.size() > MERGE_MAX_BUFFERED || !pull(board)) return false;
+    }
+    return true;
+  }
+
+  uint64_t knownEdges(const Board &board) const { return board.edgeCount; }
+
+  // true, wenn die Flanke index noch im Speicher ist.
+  bool hasEdge(const Board &board, uint64_t index) const
+  {
+    return index >= board.edgeBase && index < board.edgeCount;
+  }
+
+  // Nur nach hasEdge aufrufen.
+  double edgeAt(const Board &board, uint64_t index) const
+  {
+    return board.edges[index - board.edgeBase];
+  }
+
+  // Vergleicht die Lnge des neuen Abschnitts der Referenz mit allen anderen Crashwagerl.
+  void checkSegment()
+  {
+    Board &ref = *boards_[0];
+    double refLength = edgeAt(ref, segment_) - edgeAt(ref, segment_ - 1);
+    for (size_t b = 1; b < boards_.size(); b++)
+    {
+      Board &board = *boards_[b];
+      fillEdges(board, segment_ + 1);
+      if (!hasEdge(board, segment_ - 1) || !hasEdge(board, segment_)) continue;
+      double length = edgeAt(board, segment_) - edgeAt(board, segment_ - 1);
+      if (std::fabs(length / refLength - 1) > MERGE_EDGE_TOLERANCE) board.mismatched++;
+      board.lastCommonEdge = edgeAt(board, segment_);
+      board.lastReferenceEdge = edgeAt(ref, segment_);
+    }
+  }
+
+  // Verwirft die Flanken vor dem vorigen Abschnitt. Die Umrechnung steht in Board::map*.
+  void trimEdges()
+  {
+    for (auto &board : boards_)
+    {
+      while (board->edgeBase + 1 < segment_ && !board->edges.empty())
+      {
+        board->edges.pop_front();
+        board->edgeBase++;
+      }
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * bernimmt die Flanken des aktuellen Abschnitts in die Umrechnung, wenn sie bei der Referenz
+  * und beim Crashwagerl da sind. Sonst bleibt der vorige Abschnitt (nach der letzten Flanke, bei
+  * einer krzeren Aufzeichnung). Gibt es erst eine gemeinsame Flanke, wird nur der Offset
+  * verwendet.
+  * @param board: Crashwagerl.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  void updateMapping(Board &board)
+  {
+    const Board &ref = *boards_[0];
+    uint64_t next = segment_ + 1;
+
+    if (hasEdge(board, segment_) && hasEdge(board, next) && hasEdge(ref, segment_) &&
+        hasEdge(ref, next))
+    {
+      board.mapReference = edgeAt(ref, segment_);
+      board.mapStart = edgeAt(board, segment_);
+      board.mapRatio = (edgeAt(board, next) - board.mapStart) /
+                       (edgeAt(ref, next) - board.mapReference);
+      board.mapped = true;
+    }
+    else if (!board.mapped && hasEdge(board, segment_) && hasEdge(ref, segment_))
+    {
+      board.mapReference = edgeAt(ref, segment_);
+      board.mapStart = edgeAt(board, segment_);
+      board.mapRatio = 1;
+      board.mapped = true;
+    }
+  }
+
+  // Rechnet eine Zeit der Referenz in die Zeit eines Crashwagerl um (s. updateMapping).
+  double mapTime(const Board &board, double refTime) const
+  {
+    return board.mapStart + (refTime - board.mapReference) * board.mapRatio;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Interpoliert die Werte eines Crashwagerl zu seiner Zeit time. ltere Messungen werden
+  * verworfen, da die Zeit nur steigt.
+  * @param board: Crashwagerl.
+  * @param time: Zeit des Crashwagerl.
+  * @return Werte, channels enthlt die Kanle mit einem Wert.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  MergedValues interpolate(Board &board, double time)
+  {
+    MergedValues result{{0, 0, 0}, 0};
+
+    // Messungen bis MERGE_PLAN_SEARCH nach dem Zeitpunkt holen.
+    while (!board.ended && countAfter(board, time) < MERGE_PLAN_SEARCH)
+    {
+      if (!pull(board)) break;
+    }
+    // Vorne hchstens MERGE_PLAN_SEARCH Messungen vor dem Zeitpunkt behalten.
+    while (board.samples.size() > MERGE_PLAN_SEARCH + 1 &&
+           board.samples[MERGE_PLAN_SEARCH].time <= time)
+    {
+      board.samples.pop_front();
+    }
+
+    size_t after = 0;
+    while (after < board.samples.size() && board.samples[after].time <= time) after++;
+    for (unsigned ch = 0; ch < 3; ch++)
+    {
+      const MergeItem *beforePtr = nullptr;
+      const MergeItem *afterPtr = nullptr;
+      for (size_t i = after; i-- > 0 && !beforePtr;)
+      {
+        if (board.samples[i].channels & (1 << ch)) beforePtr = &board.samples[i];
+      }
+      for (size_t i = after; i < board.samples.size() && !afterPtr; i++)
+      {
+        if (board.samples[i].channels & (1 << ch)) afterPtr = &board.samples[i];
+      }
+      if (!beforePtr || !afterPtr || afterPtr->time - beforePtr->time > MERGE_MAX_GAP) continue;
+      double fraction = (time - beforePtr->time) / (afterPtr->time - beforePtr->time);
+      result.values[ch] = static_cast<uint16_t>(std::lround(
+          beforePtr->values[ch] + fraction * (afterPtr->values[ch] - beforePtr->values[ch])));
+      result.channels |= 1 << ch;
+    }
+    return result;
+  }
+
+  // Anzahl der Messungen nach time, hchstens MERGE_PLAN_SEARCH.
+  size_t countAfter(const Board &board, double time) const
+  {
+    size_t count = 0;
+    for (size_t i = board.samples.size(); i-- > 0 && board.samples[i].time > time &&
+                                          count < MERGE_PLAN_SEARCH;)
+    {
+      count++;
+    }
+    return count;
+  }
+
+  void stop()
+  {
+    stopRequested_ = true;
+    for (auto &board : boards_)
+    {
+      if (board->reader.joinable()) board->reader.join();
+    }
+  }
+
+  std::vector<std::unique_ptr<Board>> boards_;
+  unsigned syncChannel_;
+  uint16_t threshold_;
+  uint16_t hysteresis_;
+  std::atomic<bool> stopRequested_{false};
+  uint64_t segment_ = 0;               // Nummer der Flanke am Anfang des aktuellen Abschnitts
+  uint64_t dropped_ = 0;
+};
+
+}  // namespace crashwagerl
+
+#endif /* MERGEENGINE_H_ */
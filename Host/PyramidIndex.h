@@ -0,0 +1,327 @@
+/*
+****************************************************************************************************
+PYRAMIDINDEX.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  bersichtsindex fr lange Aufzeichnungen (POSIX, C++17). Zu einer Aufzeichnung aus
+       CaptureFile.h wird die Datei pyramid.bin geschrieben. Sie enthlt fr Ch1..Ch3 Minimum,
+       Maximum, Mittelwert und Anzahl der Werte ber Blcke von 2^(PYRAMID_BASE_LOG2 + k)
+       Zeilen (Stufe k = 0, 1, 2, ...). Ein Block der Stufe k + 1 fasst 2 Blcke der Stufe k
+       zusammen. Kanle ohne Wert (CAPTURE_NO_VALUE, Kanalplan) werden nicht mitgezhlt.
+
+       Die Eintrge werden in der Reihenfolge geschrieben, in der die Blcke fertig werden: Erst
+       beide Hlften, dann der Block darber. Die Datei wchst daher nur am Ende und kann whrend
+       der Aufzeichnung geschrieben werden (PyramidWriter, z. B. in crashcapture). Der Eintrag
+       fr Block i der Stufe k liegt an der Position
+         (i + 1) * (2^(k+1) - 1) + i - popcount(i) - 1
+       Nach n vollstndigen Blcken der Stufe 0 hat die Datei 2n - popcount(n) Eintrge.
+       Die letzten Zeilen, die noch keinen Block der Stufe 0 fllen, stehen nur in den Spalten.
+
+       PyramidReader bildet die Spalten und den Index mit mmap ab. summarize() deckt einen
+       beliebigen Zeilenbereich mit mglichst groen vollstndigen Blcken ab und liest nur an
+       den Rndern hchstens 2 * 2^PYRAMID_BASE_LOG2 Zeilen aus den Spalten. query() teilt einen
+       Bereich in gleich breite Pixel auf. Gelesen werden so O(Pixel * Stufen) Eintrge,
+       unabhngig von der Lnge des Bereichs.
+****************************************************************************************************
+*/
+
+#ifndef PYRAMIDINDEX_H_
+#define PYRAMIDINDEX_H_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "CaptureFile.h"
+
+namespace crashwagerl
+{
+
+constexpr unsigned PYRAMID_BASE_LOG2 = 4;           // Stufe 0 fasst 16 Zeilen zusammen
+constexpr size_t PYRAMID_BASE_ROWS = size_t(1) << PYRAMID_BASE_LOG2;
+constexpr unsigned PYRAMID_CHANNELS = 3;            // Ch1..Ch3
+constexpr unsigned PYRAMID_MAX_LEVELS = 64 - PYRAMID_BASE_LOG2;
+// pyramid.bin hat knapp 2 Eintrge pro PYRAMID_BASE_ROWS Zeilen.
+constexpr size_t PYRAMID_GROW_ENTRIES = 2 * CAPTURE_GROW_ROWS / PYRAMID_BASE_ROWS;
+
+// Zusammenfassung eines Kanals ber einen Block. Ohne Werte ist count 0, min 0xFFFF und max 0.
+struct PyramidChannel
+{
+  uint16_t min;
+  uint16_t max;
+  uint32_t count;
+  float mean;
+};
+
+struct PyramidEntry
+{
+  PyramidChannel channels[PYRAMID_CHANNELS];
+};
+
+// Position des Eintrags fr Block index der Stufe level in pyramid.bin.
+inline size_t pyramidPosition(unsigned level, size_t index)
+{
+  return (index + 1) * ((size_t(2) << level) - 1) + index - __builtin_popcountll(index) - 1;
+}
+
+// Anzahl der Eintrge nach blocks vollstndigen Blcken der Stufe 0.
+inline size_t pyramidEntries(size_t blocks)
+{
+  return 2 * blocks - __builtin_popcountll(blocks);
+}
+
+inline PyramidEntry emptyPyramidEntry()
+{
+  PyramidEntry entry;
+  for (PyramidChannel &channel : entry.channels) channel = PyramidChannel{0xFFFF, 0, 0, 0.0f};
+  return entry;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Nimmt einen zweiten Block in einen Eintrag auf. Der Mittelwert wird nach der Anzahl gewichtet.
+* @param target: Ziel.
+* @param other: Aufzunehmender Block.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+inline void mergePyramidEntry(PyramidEntry &target, const PyramidEntry &other)
+{
+  for (unsigned ch = 0; ch < PYRAMID_CHANNELS; ch++)
+  {
+    PyramidChannel &to = target.channels[ch];
+    const PyramidChannel &from = other.channels[ch];
+    if (!from.count) continue;
+    uint32_t count = to.count + from.count;
+    to.mean = static_cast<float>((static_cast<double>(to.mean) * to.count +
+                                  static_cast<double>(from.mean) * from.count) / count);
+    to.count = count;
+    to.min = std::min(to.min, from.min);
+    to.max = std::max(to.max, from.max);
+  }
+}
+
+// Nimmt einen einzelnen Wert auf, CAPTURE_NO_VALUE wird ignoriert.
+inline void addPyramidValue(PyramidChannel &channel, uint16_t value)
+{
+  if (value == CAPTURE_NO_VALUE) return;
+  channel.count++;
+  channel.mean += (value - channel.mean) / channel.count;
+  channel.min = std::min(channel.min, value);
+  channel.max = std::max(channel.max, value);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schreibt pyramid.bin Zeile fr Zeile mit. Im Speicher liegen nur der angefangene Block der
+* Stufe 0 und pro Stufe die fertige linke Hlfte des nchsten Blocks.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PyramidWriter
+{
+public:
+  ~PyramidWriter() { close(); }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Legt pyramid.bin im Verzeichnis der Aufzeichnung an.
+  * @param directory: Verzeichnis der Aufzeichnung (muss existieren).
+  * @return false bei einem Fehler (wurde schon mit perror ausgegeben).
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool open(const std::string &directory)
+  {
+    entries_ = 0;
+    rows_ = 0;
+    pendingMask_ = 0;
+    sums_.fill(0);
+    block_ = emptyPyramidEntry();
+    return file_.open(directory + "/pyramid.bin");
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Nimmt eine Zeile auf, in der gleichen Reihenfolge wie CaptureFile::append.
+  * @param sample: Messwert.
+  * @return false, wenn die Datei nicht vergrert werden konnte.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool append(const TimedSample &sample)
+  {
+    const uint16_t values[PYRAMID_CHANNELS] = {sample.ch1, sample.ch2, sample.ch3};
+
+    for (unsigned ch = 0; ch < PYRAMID_CHANNELS; ch++)
+    {
+      if (!(sample.channels & (1 << ch))) continue;
+      PyramidChannel &channel = block_.channels[ch];
+      channel.count++;
+      channel.min = std::min(channel.min, values[ch]);
+      channel.max = std::max(channel.max, values[ch]);
+      sums_[ch] += values[ch];
+    }
+    if (++rows_ % PYRAMID_BASE_ROWS) return true;
+
+    // Stufe 0 ist voll. Der Mittelwert wird hier exakt aus der Summe berechnet.
+    for (unsigned ch = 0; ch < PYRAMID_CHANNELS; ch++)
+    {
+      PyramidChannel &channel = block_.channels[ch];
+      if (channel.count) channel.mean = static_cast<float>(sums_[ch]) / channel.count;
+    }
+    bool written = emit(0, block_);
+    block_ = emptyPyramidEntry();
+    sums_.fill(0);
+    return written;
+  }
+
+  // Krzt die Datei auf die geschriebenen Eintrge und schliet sie.
+  void close() { file_.close(entries_); }
+
+private:
+  // Schreibt einen fertigen Block und bildet, wenn er eine rechte Hlfte ist, den Block darber.
+  bool emit(unsigned level, const PyramidEntry &entry)
+  {
+    if (!file_.set(entries_++, entry)) return false;
+    if (level + 1 >= PYRAMID_MAX_LEVELS) return true;
+    if (!(pendingMask_ & (uint64_t(1) << level)))
+    {
+      pending_[level] = entry;
+      pendingMask_ |= uint64_t(1) << level;
+      return true;
+    }
+    pendingMask_ &= ~(uint64_t(1) << level);
+    PyramidEntry parent = pending_[level];
+    mergePyramidEntry(parent, entry);
+    return emit(level + 1, parent);
+  }
+
+  MappedColumn<PyramidEntry> file_{PYRAMID_GROW_ENTRIES};
+  size_t entries_ = 0;
+  size_t rows_ = 0;
+  PyramidEntry block_ = emptyPyramidEntry();
+  std::array<uint64_t, PYRAMID_CHANNELS> sums_{};
+  std::array<PyramidEntry, PYRAMID_MAX_LEVELS> pending_;
+  uint64_t pendingMask_ = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liest eine geschlossene Aufzeichnung mit pyramid.bin.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PyramidReader
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Bildet Zeit, Ch1..Ch3 und den Index ab und prft, ob der Index zur Aufzeichnung passt.
+  * @param directory: Verzeichnis der Aufzeichnung.
+  * @return false bei einem Fehler (wurde schon ausgegeben).
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  bool open(const std::string &directory)
+  {
+    if (!time_.open(directory + "/time.u64") || !channels_[0].open(directory + "/ch1.u16") ||
+        !channels_[1].open(directory + "/ch2.u16") || !channels_[2].open(directory + "/ch3.u16") ||
+        !pyramid_.open(directory + "/pyramid.bin"))
+    {
+      return false;
+    }
+    rows_ = time_.size();
+    blocks_ = rows_ >> PYRAMID_BASE_LOG2;
+    if (channels_[0].size() != rows_ || channels_[1].size() != rows_ ||
+        channels_[2].size() != rows_ || pyramid_.size() != pyramidEntries(blocks_))
+    {
+      fprintf(stderr, "%s: Index passt nicht zur Aufzeichnung\n", directory.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  size_t rows() const { return rows_; }
+
+  // Erste Zeile mit einer Zeit >= time (rows(), wenn es keine gibt).
+  size_t rowAtTime(uint64_t time) const
+  {
+    return std::lower_bound(time_.begin(), time_.end(), time) - time_.begin();
+  }
+
+  uint64_t timeAtRow(size_t row) const { return time_[row]; }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Fasst die Zeilen [begin, end) zusammen. Vollstndige Blcke werden aus dem Index genommen,
+  * immer der grte, der an der aktuellen Zeile beginnt und in den Bereich passt.
+  * @param begin: Erste Zeile.
+  * @param end: Zeile nach der letzten.
+  * @return Zusammenfassung.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  PyramidEntry summarize(size_t begin, size_t end) const
+  {
+    PyramidEntry result = emptyPyramidEntry();
+    size_t indexedEnd = std::min(end, blocks_ << PYRAMID_BASE_LOG2);
+    size_t row = begin;
+
+    while (row < end)
+    {
+      size_t block = row >> PYRAMID_BASE_LOG2;
+      if (row % PYRAMID_BASE_ROWS || row + PYRAMID_BASE_ROWS > indexedEnd)
+      {
+        for (unsigned ch = 0; ch < PYRAMID_CHANNELS; ch++)
+        {
+          addPyramidValue(result.channels[ch], channels_[ch][row]);
+        }
+        row++;
+        continue;
+      }
+      unsigned level = 0;
+      while (level + 1 < PYRAMID_MAX_LEVELS && !(block & ((size_t(2) << level) - 1)) &&
+             row + (PYRAMID_BASE_ROWS << (level + 1)) <= indexedEnd)
+      {
+        level++;
+      }
+      mergePyramidEntry(result, pyramid_[pyramidPosition(level, block >> level)]);
+      row += PYRAMID_BASE_ROWS << level;
+    }
+    return result;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Teilt die Zeilen [begin, end) in pixels gleich breite Bereiche und fasst jeden zusammen.
+  * Sind es weniger Zeilen als Pixel, wird jede Zeile einzeln geliefert.
+  * @param begin: Erste Zeile.
+  * @param end: Zeile nach der letzten.
+  * @param pixels: Anzahl der Bereiche.
+  * @param onPixel: Funktion mit den Parametern (size_t erste Zeile, size_t Zeile nach der
+  *                 letzten, const PyramidEntry &).
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  template <class Callback>
+  void query(size_t begin, size_t end, size_t pixels, Callback &&onPixel) const
+  {
+    end = std::min(end, rows_);
+    if (begin >= end || !pixels) return;
+    pixels = std::min(pixels, end - begin);
+    size_t pixelBegin = begin;
+    for (size_t pixel = 1; pixel <= pixels; pixel++)
+    {
+      size_t pixelEnd = begin + (end - begin) * pixel / pixels;
+      onPixel(pixelBegin, pixelEnd, summarize(pixelBegin, pixelEnd));
+      pixelBegin = pixelEnd;
+    }
+  }
+
+private:
+  ReadOnlyColumn<uint64_t> time_;
+  ReadOnlyColumn<uint16_t> channels_[PYRAMID_CHANNELS];
+  ReadOnlyColumn<PyramidEntry> pyramid_;
+  size_t rows_ = 0;
+  size_t blocks_ = 0;
+};
+
+}  // namespace crashwagerl
+
+#endif /* PYRAMIDINDEX_H_ */
@@ -0,0 +1,105 @@
+/*
+****************************************************************************************************
+SPSCRING.H
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Ringpuffer ohne Locks fr genau einen schreibenden und einen lesenden Thread (C++17).
+       Der Schreiber wartet nie: Ist der Puffer voll, schreibt write() nur so viel wie Platz hat
+       und der Aufrufer entscheidet, was mit dem Rest passiert. Schreib- und Leseposition laufen
+       frei und werden erst beim Zugriff mit der Maske begrenzt, dadurch ist der Puffer auch ganz
+       voll nutzbar.
+****************************************************************************************************
+*/
+
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace crashwagerl
+{
+
+class SpscRing
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * @param capacity: Gre in Bytes, wird auf eine 2er Potenz aufgerundet.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  explicit SpscRing(size_t capacity)
+  {
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+    buffer_.resize(size);
+    mask_ = size - 1;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Schreibt Bytes in den Puffer. Nur vom schreibenden Thread aufrufen.
+  * @param dataPtr: Bytes.
+  * @param len: Anzahl der Bytes.
+  * @return Anzahl der geschriebenen Bytes, kleiner als len, wenn der Puffer voll ist.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  size_t write(const uint8_t *dataPtr, size_t len)
+  {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    len = std::min(len, capacity() - (head - tail));
+    size_t start = head & mask_;
+    size_t first = std::min(len, buffer_.size() - start);
+    std::memcpy(buffer_.data() + start, dataPtr, first);
+    std::memcpy(buffer_.data(), dataPtr + first, len - first);
+    head_.store(head + len, std::memory_order_release);
+    return len;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  /**
+  * Liest Bytes aus dem Puffer. Nur vom lesenden Thread aufrufen.
+  * @param dataPtr: Ziel.
+  * @param maxLen: Gre des Ziels.
+  * @return Anzahl der gelesenen Bytes, 0 wenn der Puffer leer ist.
+  */
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  size_t read(uint8_t *dataPtr, size_t maxLen)
+  {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t len = std::min(maxLen, head - tail);
+    size_t start = tail & mask_;
+    size_t first = std::min(len, buffer_.size() - start);
+    std::memcpy(dataPtr, buffer_.data() + start, first);
+    std::memcpy(dataPtr + first, buffer_.data(), len - first);
+    tail_.store(tail + len, std::memory_order_release);
+    return len;
+  }
+
+  // Belegte Bytes. Aus jedem Thread aufrufbar, der Wert ist nur eine Momentaufnahme.
+  size_t size() const
+  {
+    // Erst tail lesen, head kann inzwischen nur grer geworden sein.
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return head_.load(std::memory_order_acquire) - tail;
+  }
+
+  size_t capacity() const { return buffer_.size(); }
+
+private:
+  std::vector<uint8_t> buffer_;
+  size_t mask_;
+  // Eigene Cache Lines, damit sich Schreiber und Leser nicht gegenseitig ausbremsen.
+  alignas(64) std::atomic<size_t> head_{0};   // Nur vom Schreiber verndert
+  alignas(64) std::atomic<size_t> tail_{0};   // Nur vom Leser verndert
+};
+
+}  // namespace crashwagerl
+
+#endif /* SPSCRING_H_ */
@@ -0,0 +1,210 @@
+/*
+****************************************************************************************************
+CRASHBENCH: Misst den Durchsatz der base64 Decoder.
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Decodiert eine Aufzeichnung (base64 Format) mehrmals mit Base64FrameDecoder und
+       Base64BulkDecoder und gibt Nachrichten pro Sekunde und MB/s aus. Die Bytes werden wie bei
+       crashdecode in Blcken zu 64 kB bergeben, die Datei wird vorher komplett eingelesen,
+       damit nur der Decoder gemessen wird. Beide Ergebnisse und Zhler werden verglichen.
+       Ohne Datei wird eine Aufzeichnung mit 1 000 000 Nachrichten erzeugt, in der einige
+       Nachrichten beschdigt sind.
+
+       Aufruf:       crashbench [-n wiederholungen] [datei]
+       bersetzen:   g++ -O2 -march=native -std=c++17 -o crashbench crashbench.cpp
+****************************************************************************************************
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CrashwagerlBulkDecoder.h"
+
+using namespace crashwagerl;
+
+static const size_t BLOCK_SIZE = 65536;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erzeugt eine Aufzeichnung wie vom Crashwagerl. Jede 997. Nachricht hat ein ungltiges Zeichen,
+* jede 1499. ist um ein Zeichen zu kurz.
+* @param frames: Anzahl der Nachrichten.
+* @return Bytes der Aufzeichnung.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static std::vector<uint8_t> makeRecording(size_t frames)
+{
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::vector<uint8_t> data;
+  uint32_t noise = 1;
+
+  data.reserve(frames * BASE64_FRAME_LENGTH);
+  for (size_t i = 0; i < frames; i++)
+  {
+    uint32_t fields[5];
+    uint8_t frame[BASE64_FRAME_LENGTH];
+    noise = noise * 1103515245 + 12345;
+    fields[0] = i & 0xFFFFFF;
+    fields[1] = 340 + ((noise >> 8) & 7);
+    fields[2] = (noise >> 12) & 0x3FF;
+    fields[3] = (i * 7) & 0x3FF;
+    fields[4] = 1023 - (i & 0x3FF);
+    for (size_t c = 0; c < 4; c++) frame[c] = alphabet[(fields[0] >> (18 - 6 * c)) & 0x3F];
+    for (size_t f = 1; f < 5; f++)
+    {
+      frame[2 + 2 * f] = alphabet[(fields[f] >> 6) & 0x3F];
+      frame[3 + 2 * f] = alphabet[fields[f] & 0x3F];
+    }
+    frame[12] = '\r';
+    frame[13] = '\n';
+    if (i % 997 == 500) frame[7] = '*';
+    if (i % 1499 == 700)
+    {
+      data.insert(data.end(), frame + 1, frame + BASE64_FRAME_LENGTH);
+      continue;
+    }
+    data.insert(data.end(), frame, frame + BASE64_FRAME_LENGTH);
+  }
+  return data;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liest eine Datei komplett ein.
+* @param fileName: Name der Datei.
+* @param data: Ziel.
+* @return false, wenn die Datei nicht gelesen werden kann.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool readFile(const char *fileName, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(fileName, "rb");
+  uint8_t buffer[BLOCK_SIZE];
+  size_t len;
+
+  if (!file)
+  {
+    perror(fileName);
+    return false;
+  }
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + len);
+  }
+  fclose(file);
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Fhrt decode mehrmals aus und liefert die krzeste Zeit.
+* @param repeat: Anzahl der Durchlufe.
+* @param decode: Funktion ohne Parameter.
+* @return Zeit in Sekunden.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Function>
+static double bestTime(int repeat, Function &&decode)
+{
+  double best = 1e9;
+  for (int i = 0; i < repeat; i++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    decode();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+    if (time.count() < best) best = time.count();
+  }
+  return best;
+}
+
+static void printResult(const char *name, size_t frames, size_t bytes, double time)
+{
+  printf("%-20s %12.0f Nachrichten/s %9.1f MB/s\n", name, frames / time, bytes / time / 1e6);
+}
+
+static bool sameStats(const DecoderStats &a, const DecoderStats &b)
+{
+  return a.frames == b.frames && a.corrupted == b.corrupted && a.skippedBytes == b.skippedBytes;
+}
+
+int main(int argc, char **argv)
+{
+  int repeat = 10;
+  const char *fileName = nullptr;
+  std::vector<uint8_t> data;
+  SampleColumns reference;
+  SampleColumns columns;
+  DecoderStats referenceStats;
+  DecoderStats bulkStats;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) repeat = atoi(argv[++i]);
+    else fileName = argv[i];
+  }
+  if (repeat < 1) repeat = 1;
+  if (fileName)
+  {
+    if (!readFile(fileName, data)) return 1;
+  }
+  else
+  {
+    data = makeRecording(1000000);
+  }
+
+  double referenceTime = bestTime(repeat, [&]()
+  {
+    Base64FrameDecoder decoder;
+    reference.clear();
+    for (size_t pos = 0; pos < data.size(); pos += BLOCK_SIZE)
+    {
+      decoder.feed(data.data() + pos, std::min(BLOCK_SIZE, data.size() - pos),
+                   [&](const Sample &sample)
+      {
+        reference.timecode.push_back(sample.timecode);
+        reference.ref.push_back(sample.ref);
+        reference.ch1.push_back(sample.ch1);
+        reference.ch2.push_back(sample.ch2);
+        reference.ch3.push_back(sample.ch3);
+      });
+    }
+    referenceStats = decoder.stats();
+  });
+
+  double bulkTime = bestTime(repeat, [&]()
+  {
+    Base64BulkDecoder decoder;
+    columns.clear();
+    for (size_t pos = 0; pos < data.size(); pos += BLOCK_SIZE)
+    {
+      decoder.feed(data.data() + pos, std::min(BLOCK_SIZE, data.size() - pos), columns);
+    }
+    bulkStats = decoder.stats();
+  });
+
+#if defined(__AVX2__)
+  const char *bulkName = "Bulk (AVX2)";
+#elif defined(__SSSE3__)
+  const char *bulkName = "Bulk (SSSE3)";
+#else
+  const char *bulkName = "Bulk (Tabelle)";
+#endif
+  printf("%zu Bytes, %zu Nachrichten, fehlerhaft: %llu, verworfene Bytes: %llu\n", data.size(),
+         reference.size(), (unsigned long long)referenceStats.corrupted,
+         (unsigned long long)referenceStats.skippedBytes);
+  printResult("Base64FrameDecoder", reference.size(), data.size(), referenceTime);
+  printResult(bulkName, columns.size(), data.size(), bulkTime);
+
+  if (reference.timecode != columns.timecode || reference.ref != columns.ref ||
+      reference.ch1 != columns.ch1 || reference.ch2 != columns.ch2 ||
+      reference.ch3 != columns.ch3 || !sameStats(referenceStats, bulkStats))
+  {
+    fprintf(stderr, "Fehler: Die Ergebnisse der Decoder sind unterschiedlich.\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,454 @@
+/*
+****************************************************************************************************
+CRASHCAPTURE: Zeichnet den Datenstrom eines oder mehrerer Crashwagerl auf (Linux).
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Pro serieller Schnittstelle gibt es 2 Threads:
+         - Der Lesethread liest die Bytes von der Schnittstelle und schreibt sie in einen
+           Ringpuffer ohne Locks (SpscRing.h). Er wartet nie auf die Festplatte. Ist der Puffer
+           voll, werden die Bytes verworfen und gezhlt.
+         - Der Decoderthread holt die Bytes aus dem Ringpuffer, decodiert sie mit dem
+           StreamReceiver und hngt die Messwerte an die Spaltendateien an (CaptureFile.h).
+           Dabei wird auch der bersichtsindex pyramid.bin geschrieben (PyramidIndex.h).
+       Jede Sekunde werden pro Schnittstelle die empfangenen und verworfenen Bytes, der Fllstand
+       des Ringpuffers (aktuell und maximal) und die Zhler des Empfngers auf stderr ausgegeben.
+       Mit -t werden statt echter Schnittstellen Pseudoterminals angelegt, in die ein Thread
+       Nachrichten wie vom Crashwagerl schreibt (Timecode ab kurz vor dem 24 Bit berlauf, alle
+       10 000 Nachrichten fehlt ein Byte und im base64 und Binrformat wird eine Nachricht doppelt
+       gesendet). Damit kann ohne Hardware getestet werden, nach n Sekunden mit 1000 Nachrichten
+       pro Sekunde mssen rd. n / 10 Nachrichten fehlerhaft und ebenso viele doppelt sein.
+
+       Aufruf:       crashcapture [-b|-d] [-o verzeichnis] [-n sekunden] [-r nachrichten/s]
+                                  (-t anzahl | schnittstelle...)
+                     -b, -d:   Binr- bzw. Deltaformat, sonst base64.
+                     -o:       Zielverzeichnis (Standard capture), darin je Schnittstelle ein
+                               Unterverzeichnis dev0, dev1, ...
+                     -n:       Nach so vielen Sekunden beenden, sonst bis Strg+C.
+                     -t:       Anzahl der Pseudoterminals fr den Test.
+                     -r:       Nachrichten pro Sekunde im Test (Standard 1000).
+       bersetzen:   g++ -O2 -std=c++17 -pthread -o crashcapture crashcapture.cpp
+****************************************************************************************************
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "CaptureFile.h"
+#include "CrashwagerlReceiver.h"
+#include "PyramidIndex.h"
+#include "SpscRing.h"
+
+using namespace crashwagerl;
+
+static const size_t RING_SIZE = 1 << 20;       // Bei 460 800 Baud rd. 20 s
+static const size_t READ_BLOCK_SIZE = 4096;
+
+static std::atomic<bool> stopRequested{false};
+
+static void onSignal(int)
+{
+  stopRequested = true;
+}
+
+// Zhler des Lesethreads.
+struct ReaderStats
+{
+  std::atomic<uint64_t> bytesRead{0};
+  std::atomic<uint64_t> bytesLost{0};        // Verworfen, weil der Ringpuffer voll war
+  std::atomic<uint64_t> ringPeak{0};         // Maximaler Fllstand in Bytes
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Eine Schnittstelle mit Ringpuffer, Empfnger und Aufzeichnung. Die Schnittstelle wird im
+* Destruktor geschlossen, die Dateien von CaptureFile und PyramidWriter. So wird auch bei einem
+* Fehler beim ffnen einer spteren Schnittstelle alles freigegeben.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+struct Device
+{
+  ~Device()
+  {
+    if (fd >= 0) close(fd);
+  }
+
+  std::string path;
+  int fd = -1;
+  SpscRing ring{RING_SIZE};
+  StreamReceiver<Decoder> receiver;
+  CaptureFile file;
+  PyramidWriter pyramid;
+  ReaderStats readerStats;
+  std::atomic<bool> readerDone{false};
+  std::atomic<bool> writeFailed{false};
+  std::thread reader;
+  std::thread decoder;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ffnet eine Schnittstelle im Raw Modus mit 460 800 Baud. CR und LF drfen nicht umgewandelt
+* werden, das gilt auch fr die Pseudoterminals.
+* @param path: Name der Schnittstelle.
+* @return Filedeskriptor oder -1.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static int openSerial(const char *path)
+{
+  struct termios tty;
+  int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+  {
+    perror(path);
+    return -1;
+  }
+  if (tcgetattr(fd, &tty) == 0)
+  {
+    cfmakeraw(&tty);
+#ifdef B460800
+    cfsetispeed(&tty, B460800);
+#endif
+    tty.c_cflag |= CLOCAL | CREAD;
+    if (tcsetattr(fd, TCSANOW, &tty) < 0) perror(path);
+  }
+  return fd;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Lesethread: Schnittstelle -> Ringpuffer. Endet bei stopRequested, am Dateiende oder bei einem
+* Lesefehler.
+* @param device: Schnittstelle.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+static void readLoop(Device<Decoder> &device)
+{
+  uint8_t buffer[READ_BLOCK_SIZE];
+  struct pollfd pollFd = {device.fd, POLLIN, 0};
+
+  while (!stopRequested)
+  {
+    if (poll(&pollFd, 1, 100) <= 0) continue;
+    ssize_t len = read(device.fd, buffer, sizeof(buffer));
+    if (len < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+    if (len <= 0)
+    {
+      if (len < 0) perror(device.path.c_str());
+      break;
+    }
+    size_t written = device.ring.write(buffer, len);
+    device.readerStats.bytesRead += len;
+    if (written < static_cast<size_t>(len)) device.readerStats.bytesLost += len - written;
+    uint64_t fill = device.ring.size();
+    if (fill > device.readerStats.ringPeak) device.readerStats.ringPeak = fill;
+  }
+  device.readerDone = true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decoderthread: Ringpuffer -> Empfnger -> Spaltendateien. Ist der Puffer leer, wird 1 ms
+* gewartet. Endet, wenn der Lesethread fertig und der Puffer leer ist.
+* @param device: Schnittstelle.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+static void decodeLoop(Device<Decoder> &device)
+{
+  uint8_t buffer[65536];
+
+  while (true)
+  {
+    bool readerDone = device.readerDone;
+    size_t len = device.ring.read(buffer, sizeof(buffer));
+    if (!len)
+    {
+      if (readerDone) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    device.receiver.feed(buffer, len, [&](const TimedSample &sample)
+    {
+      if (!device.writeFailed && (!device.file.append(sample) || !device.pyramid.append(sample)))
+      {
+        device.writeFailed = true;
+      }
+    });
+  }
+  device.file.close();
+  device.pyramid.close();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erzeugt eine Nachricht wie der Crashwagerl.
+* @param format: FRAME_FORMAT_BASE64, FRAME_FORMAT_BINARY oder FRAME_FORMAT_DELTA.
+* @param encoderPtr: Zustand des Deltaencoders.
+* @param framePtr: Puffer mit mindestens BASE64_FRAME_LENGTH Bytes.
+* @param timecode: Timecode (24 Bit).
+* @return Lnge der Nachricht.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static size_t encodeTestFrame(int format, DELTA_ENCODER *encoderPtr, uint8_t *framePtr,
+                              uint32_t timecode)
+{
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  uint16_t values[4] = {345, static_cast<uint16_t>(timecode & 0x3FF),
+                        static_cast<uint16_t>((timecode * 7) & 0x3FF),
+                        static_cast<uint16_t>(512 + (timecode & 0x0F))};
+
+  if (format == FRAME_FORMAT_BINARY)
+  {
+    encodeBinaryFrame(framePtr, timecode, values[0], values[1], values[2], values[3]);
+    return BINARY_FRAME_LENGTH;
+  }
+  if (format == FRAME_FORMAT_DELTA)
+  {
+    return encodeDeltaSample(encoderPtr, framePtr, timecode, values);
+  }
+  for (size_t i = 0; i < 4; i++) framePtr[i] = alphabet[(timecode >> (18 - 6 * i)) & 0x3F];
+  for (size_t i = 0; i < 4; i++)
+  {
+    framePtr[4 + 2 * i] = alphabet[(values[i] >> 6) & 0x3F];
+    framePtr[5 + 2 * i] = alphabet[values[i] & 0x3F];
+  }
+  framePtr[12] = '\r';
+  framePtr[13] = '\n';
+  return BASE64_FRAME_LENGTH;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Testthread: Schreibt alle 10 ms die flligen Nachrichten in ein Pseudoterminal.
+* @param masterFd: Master Seite des Pseudoterminals.
+* @param format: Nachrichtenformat.
+* @param rate: Nachrichten pro Sekunde.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void generateLoop(int masterFd, int format, unsigned rate)
+{
+  DELTA_ENCODER encoder = {{0, 0, 0}, 0};
+  uint32_t timecode = 0xFFFF00;      // Kurz vor dem berlauf, ein Vielfaches des Keyframeintervalls
+  uint64_t sent = 0;
+  std::vector<uint8_t> data;
+  auto start = std::chrono::steady_clock::now();
+
+  while (!stopRequested)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t due = static_cast<uint64_t>(elapsed.count() * rate);
+    data.clear();
+    for (; sent < due; sent++)
+    {
+      uint8_t frame[DELTA_KEYFRAME_LENGTH + BASE64_FRAME_LENGTH];
+      size_t len = encodeTestFrame(format, &encoder, frame, timecode);
+      timecode = (timecode + 1) & 0xFFFFFF;
+      // Ein verlorenes Byte, der Empfnger muss sich wieder synchronisieren.
+      if (sent % 10000 == 9999) len--;
+      data.insert(data.end(), frame, frame + len);
+      // Eine doppelte Nachricht, der Empfnger muss sie verwerfen, ohne die Zeit zu ndern. Nicht
+      // im Deltaformat, dort wrde der Abschnitt bis zum nchsten Keyframe verworfen.
+      if (sent % 10000 == 4999 && format != FRAME_FORMAT_DELTA)
+      {
+        data.insert(data.end(), frame, frame + len);
+      }
+    }
+    for (size_t pos = 0; pos < data.size() && !stopRequested;)
+    {
+      ssize_t len = write(masterFd, data.data() + pos, data.size() - pos);
+      if (len < 0)
+      {
+        if (errno != EAGAIN && errno != EINTR) return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      pos += len;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Legt ein Pseudoterminal im Raw Modus an. Die Master Seite ist nicht blockierend, damit der
+* Testthread auch bei vollem Puffer beendet werden kann.
+* @param masterFdPtr: Master Seite (zum Schreiben).
+* @return Name der Slave Seite oder ein leerer String bei einem Fehler.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static std::string openPseudoTerminal(int *masterFdPtr)
+{
+  struct termios tty;
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0 || tcgetattr(fd, &tty) < 0)
+  {
+    perror("posix_openpt");
+    if (fd >= 0) close(fd);
+    return std::string();
+  }
+  // Die Einstellungen gelten fr beide Seiten, sonst wrde CR in LF umgewandelt.
+  cfmakeraw(&tty);
+  tcsetattr(fd, TCSANOW, &tty);
+  *masterFdPtr = fd;
+  return ptsname(fd);
+}
+
+template <class Decoder>
+static void printStats(std::vector<std::unique_ptr<Device<Decoder>>> &devices)
+{
+  for (auto &device : devices)
+  {
+    ReceiverStats stats = device->receiver.stats();
+    fprintf(stderr, "%s: %llu Bytes, verloren %llu, Puffer %zu%% (max %llu%%), Nachrichten %llu, "
+            "fehlerhaft %llu, fehlend %llu, doppelt %llu%s\n",
+            device->path.c_str(), (unsigned long long)device->readerStats.bytesRead.load(),
+            (unsigned long long)device->readerStats.bytesLost.load(),
+            device->ring.size() * 100 / device->ring.capacity(),
+            (unsigned long long)(device->readerStats.ringPeak.load() * 100 /
+                                 device->ring.capacity()),
+            (unsigned long long)stats.frames, (unsigned long long)stats.corrupted,
+            (unsigned long long)stats.dropped, (unsigned long long)stats.duplicated,
+            device->writeFailed ? ", SCHREIBFEHLER" : "");
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Startet die Threads fr alle Schnittstellen, gibt jede Sekunde die Zhler aus und beendet alles
+* bei Strg+C, nach der Laufzeit oder wenn alle Schnittstellen geschlossen sind.
+* @param paths: Schnittstellen.
+* @param directory: Zielverzeichnis.
+* @param seconds: Laufzeit, 0 = unbegrenzt.
+* @return Exit Code.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+static int capture(const std::vector<std::string> &paths, const std::string &directory,
+                   unsigned seconds)
+{
+  std::vector<std::unique_ptr<Device<Decoder>>> devices;
+  auto start = std::chrono::steady_clock::now();
+  int result = 0;
+
+  if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+  {
+    perror(directory.c_str());
+    return 1;
+  }
+  for (size_t i = 0; i < paths.size(); i++)
+  {
+    auto device = std::make_unique<Device<Decoder>>();
+    device->path = paths[i];
+    if ((device->fd = openSerial(paths[i].c_str())) < 0) return 1;
+    std::string deviceDirectory = directory + "/dev" + std::to_string(i);
+    if (!device->file.open(deviceDirectory) || !device->pyramid.open(deviceDirectory)) return 1;
+    devices.push_back(std::move(device));
+  }
+  for (auto &device : devices)
+  {
+    Device<Decoder> &d = *device;
+    d.decoder = std::thread([&d]() { decodeLoop(d); });
+    d.reader = std::thread([&d]() { readLoop(d); });
+  }
+
+  while (!stopRequested)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    printStats(devices);
+    bool allDone = std::all_of(devices.begin(), devices.end(),
+                               [](const auto &device) { return device->readerDone.load(); });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (allDone || (seconds && elapsed.count() >= seconds)) stopRequested = true;
+  }
+
+  for (auto &device : devices)
+  {
+    device->reader.join();
+    device->decoder.join();
+    if (device->readerStats.bytesLost || device->writeFailed) result = 1;
+  }
+  printStats(devices);
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  int format = FRAME_FORMAT_BASE64;
+  std::string directory = "capture";
+  unsigned seconds = 0;
+  unsigned testCount = 0;
+  unsigned rate = 1000;
+  std::vector<std::string> paths;
+  std::vector<int> masterFds;
+  std::vector<std::thread> generators;
+  int result;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-b") == 0) format = FRAME_FORMAT_BINARY;
+    else if (strcmp(argv[i], "-d") == 0) format = FRAME_FORMAT_DELTA;
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) directory = argv[++i];
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) testCount = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rate = atoi(argv[++i]);
+    else paths.push_back(argv[i]);
+  }
+
+  for (unsigned i = 0; i < testCount; i++)
+  {
+    int masterFd;
+    std::string path = openPseudoTerminal(&masterFd);
+    if (path.empty()) return 1;
+    paths.push_back(path);
+    masterFds.push_back(masterFd);
+  }
+  if (paths.empty())
+  {
+    fprintf(stderr, "Aufruf: crashcapture [-b|-d] [-o verzeichnis] [-n sekunden] "
+            "[-r nachrichten/s] (-t anzahl | schnittstelle...)\n");
+    return 1;
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  for (int fd : masterFds) generators.emplace_back(generateLoop, fd, format, rate);
+
+  if (format == FRAME_FORMAT_BINARY)
+  {
+    result = capture<BinaryFrameDecoder>(paths, directory, seconds);
+  }
+  else if (format == FRAME_FORMAT_DELTA)
+  {
+    result = capture<DeltaFrameDecoder>(paths, directory, seconds);
+  }
+  else
+  {
+    result = capture<Base64FrameDecoder>(paths, directory, seconds);
+  }
+
+  stopRequested = true;
+  for (auto &generator : generators) generator.join();
+  for (int fd : masterFds) close(fd);
+  return result;
+}
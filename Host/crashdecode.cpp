@@ -0,0 +1,126 @@
+/*
+****************************************************************************************************
+CRASHDECODE: Wandelt eine Aufzeichnung des Crashwagerl UART in eine CSV Datei um.
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Liest die Rohdaten von der Datei (oder stdin) und schreibt pro Nachricht eine Zeile
+       Zeit;Ref;Ch1;Ch2;Ch3 auf stdout. Die Zeit ist der ber den berlauf nach 24 Bit
+       fortgesetzte Timecode (s. CrashwagerlReceiver.h). Kanle, die laut Kanalplan in einer
+       Messung nicht gewandelt wurden, bleiben leer. Am Ende werden die Zhler und der Kanalplan
+       auf stderr ausgegeben.
+       Mit -k liefert das Programm 1, wenn Nachrichten fehlen, doppelt oder fehlerhaft sind oder
+       Bytes verworfen wurden. Neustarts (z. B. jeder Burst im BURST_MODE) sind erlaubt. So kann
+       die Ausgabe von crashsim ab dem ersten Byte geprft werden.
+
+       Aufruf:       crashdecode [-b|-d] [-k] [datei]
+                     -b: Binrformat (FRAME_FORMAT_BINARY)
+                     -d: Deltaformat (FRAME_FORMAT_DELTA)
+                     sonst base64.
+                     -k: Verluste prfen
+       bersetzen:   g++ -O2 -std=c++17 -o crashdecode crashdecode.cpp
+****************************************************************************************************
+*/
+
+#include <cstdio>
+#include <cstring>
+
+#include "CrashwagerlReceiver.h"
+
+using namespace crashwagerl;
+
+static void printChannel(bool present, unsigned value)
+{
+  if (present) printf(";%u", value);
+  else         printf(";");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Liest die Datei blockweise und bergibt die Bytes dem Empfnger.
+* @param file: Geffnete Datei.
+* @param receiver: StreamReceiver mit dem passenden Decoder.
+* @return Zhler des Empfngers.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Receiver>
+static ReceiverStats decodeFile(FILE *file, Receiver &receiver)
+{
+  uint8_t buffer[65536];
+  size_t len;
+
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    receiver.feed(buffer, len, [](const TimedSample &sample)
+    {
+      printf("%llu;%u", (unsigned long long)sample.time, sample.ref);
+      printChannel(sample.channels & 1, sample.ch1);
+      printChannel(sample.channels & 2, sample.ch2);
+      printChannel(sample.channels & 4, sample.ch3);
+      putchar('\n');
+    });
+  }
+  ReceiverStats stats = receiver.stats();
+  fprintf(stderr, "Nachrichten: %llu, fehlerhaft: %llu, verworfene Bytes: %llu\n",
+          (unsigned long long)stats.frames, (unsigned long long)stats.corrupted,
+          (unsigned long long)stats.skippedBytes);
+  fprintf(stderr, "Fehlend: %llu, doppelt: %llu, Neustarts: %llu\n",
+          (unsigned long long)stats.dropped, (unsigned long long)stats.duplicated,
+          (unsigned long long)stats.restarts);
+  fprintf(stderr, "Kanalplan:");
+  for (uint8_t ch = 0; ch < 3; ch++)
+  {
+    uint8_t divider = planDivider(receiver.planCode(), ch);
+    if (divider) fprintf(stderr, " Ch%u 1/%u", ch + 1, divider);
+    else         fprintf(stderr, " Ch%u aus", ch + 1);
+  }
+  fprintf(stderr, "\n");
+  return stats;
+}
+
+int main(int argc, char **argv)
+{
+  bool binary = false;
+  bool delta = false;
+  bool check = false;
+  const char *fileName = nullptr;
+  FILE *file = stdin;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-b") == 0) binary = true;
+    else if (strcmp(argv[i], "-d") == 0) delta = true;
+    else if (strcmp(argv[i], "-k") == 0) check = true;
+    else fileName = argv[i];
+  }
+  if (fileName && !(file = fopen(fileName, "rb")))
+  {
+    perror(fileName);
+    return 1;
+  }
+
+  ReceiverStats stats;
+  if (delta)
+  {
+    StreamReceiver<DeltaFrameDecoder> receiver;
+    stats = decodeFile(file, receiver);
+  }
+  else if (binary)
+  {
+    StreamReceiver<BinaryFrameDecoder> receiver;
+    stats = decodeFile(file, receiver);
+  }
+  else
+  {
+    StreamReceiver<Base64FrameDecoder> receiver;
+    stats = decodeFile(file, receiver);
+  }
+
+  if (file != stdin) fclose(file);
+  if (check && (!stats.frames || stats.corrupted || stats.skippedBytes || stats.dropped ||
+                stats.duplicated))
+  {
+    fprintf(stderr, "FEHLER: Der Datenstrom ist nicht vollstndig.\n");
+    return 1;
+  }
+  return 0;
+}
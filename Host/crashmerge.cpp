@@ -0,0 +1,98 @@
+/*
+****************************************************************************************************
+CRASHMERGE: Fhrt die Aufzeichnungen mehrerer Crashwagerl auf eine Zeitachse zusammen (POSIX).
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Liest die Verzeichnisse von crashcapture (z. B. capture/dev0 capture/dev1 ...) gleichzeitig
+       mit je einem Thread und gleicht Offset und Drift der Oszillatoren ber einen gemeinsamen
+       Sync Puls ab (s. MergeEngine.h). Der Puls muss bei allen Crashwagerl am selben Kanal
+       anliegen und darf erst nach dem Einschalten aller Crashwagerl anlaufen.
+       Auf stdout wird pro Messung der ersten Aufzeichnung eine Zeile
+         Zeit;C0 Ch1;C0 Ch2;C0 Ch3;C1 Ch1;...
+       geschrieben. Die Zeit ist die der ersten Aufzeichnung, die Werte der anderen sind auf diese
+       Zeit interpoliert. Kanle ohne Wert bleiben leer. Auf stderr werden pro Crashwagerl die
+       Anzahl der Flanken, Offset und Drift zur ersten Aufzeichnung und die Sync Abschnitte
+       ausgegeben, deren Lnge um mehr als 1 % abweicht (falsch erkannte oder fehlende Flanken).
+
+       Aufruf:       crashmerge [-c kanal] [-s schwelle] [-y hysterese] verzeichnis...
+                     -c:   Kanal mit dem Sync Puls (1..3, Standard 3).
+                     -s:   Schwelle fr die steigende Flanke (Standard 512).
+                     -y:   Hysterese um die Schwelle (Standard 50).
+       bersetzen:   g++ -O2 -std=c++17 -pthread -o crashmerge crashmerge.cpp
+****************************************************************************************************
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "MergeEngine.h"
+
+using namespace crashwagerl;
+
+int main(int argc, char **argv)
+{
+  unsigned channel = 3;
+  unsigned threshold = 512;
+  unsigned hysteresis = 50;
+  std::vector<std::string> directories;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (strcmp(argv[i], "-c") == 0 && value) channel = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "-s") == 0 && value) threshold = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "-y") == 0 && value) hysteresis = strtoul(argv[++i], nullptr, 10);
+    else if (argv[i][0] != '-') directories.push_back(argv[i]);
+    else
+    {
+      fprintf(stderr, "Aufruf: crashmerge [-c kanal] [-s schwelle] [-y hysterese] "
+                      "verzeichnis...\n");
+      return 2;
+    }
+  }
+  if (directories.empty() || channel < 1 || channel > 3)
+  {
+    fprintf(stderr, "Keine Aufzeichnung oder falscher Kanal angegeben.\n");
+    return 2;
+  }
+
+  MergeEngine engine(channel - 1, threshold, hysteresis);
+  for (const std::string &directory : directories)
+  {
+    if (!engine.addBoard(directory)) return 1;
+  }
+
+  printf("Zeit");
+  for (size_t board = 0; board < engine.boards(); board++)
+  {
+    printf(";C%zu Ch1;C%zu Ch2;C%zu Ch3", board, board, board);
+  }
+  putchar('\n');
+
+  bool ok = engine.run([&](double time, const MergedValues *values)
+  {
+    printf("%.0f", time);
+    for (size_t board = 0; board < engine.boards(); board++)
+    {
+      for (unsigned ch = 0; ch < 3; ch++)
+      {
+        if (values[board].channels & (1 << ch)) printf(";%u", values[board].values[ch]);
+        else                                     printf(";");
+      }
+    }
+    putchar('\n');
+  });
+
+  fprintf(stderr, "Zeilen vor der ersten Flanke: %llu\n", (unsigned long long)engine.dropped());
+  for (size_t board = 0; board < engine.boards(); board++)
+  {
+    BoardClock clock = engine.clock(board);
+    fprintf(stderr, "%s: Flanken: %llu, Offset: %.3f, Drift: %.1f ppm, Abweichungen: %llu\n",
+            directories[board].c_str(), (unsigned long long)clock.edges, clock.offset,
+            clock.drift * 1e6, (unsigned long long)clock.mismatched);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+****************************************************************************************************
+CRASHPLANTEST: Prft den Binrdecoder mit allen Kanalplnen ab dem ersten Byte.
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Erzeugt fr jeden gltigen Kanalplan (CH1_DIVIDER bis CH3_DIVIDER 0, 1, 2 oder 4, mindestens
+       ein Kanal mit 1) einen Datenstrom wie die Firmware: die Prambel, danach pro Messung eine
+       Nachricht mit encodeBinaryPlanFrame und den Kanlen wie in AdcScheduler.h. Der Datenstrom
+       wird in kleinen Blcken an den StreamReceiver bergeben. Jede Messung muss mit Zeit,
+       Referenz, Kanlen und Werten ankommen, es darf nichts fehlen, doppelt oder fehlerhaft sein
+       und kein Byte verworfen werden. Das Programm liefert 1, wenn ein Plan das nicht erfllt.
+
+       Aufruf:       crashplantest [-n messungen]
+       bersetzen:   g++ -O2 -std=c++17 -o crashplantest crashplantest.cpp
+****************************************************************************************************
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "CrashwagerlReceiver.h"
+
+using namespace crashwagerl;
+
+constexpr uint16_t TEST_REF = 0x1A5;      // Beliebiger Referenzwert mit 10 Bit
+constexpr size_t TEST_CHUNK = 61;         // Blockgre fr feed(), teilt die Nachrichten
+
+// Wert eines Kanals bei einer Messung, damit der Empfnger vertauschte Kanle erkennt.
+static uint16_t testValue(uint32_t timecode, uint8_t channel)
+{
+  return static_cast<uint16_t>((timecode * 7 + channel * 341) & 0x3FF);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erzeugt den Datenstrom fr einen Kanalplan und prft, ob er vollstndig decodiert wird.
+* @param dividers: Teiler fr Ch1..Ch3 wie CHx_DIVIDER.
+* @param samples: Anzahl der Messungen.
+* @return true, wenn alle Messungen ohne Verluste angekommen sind.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static bool testPlan(const uint8_t *dividers, uint32_t samples)
+{
+  uint8_t planCode = (PLAN_CODE(dividers[0]) << 4) | (PLAN_CODE(dividers[1]) << 2) |
+                     PLAN_CODE(dividers[2]);
+  std::vector<uint8_t> stream(BINARY_PREAMBLE_LENGTH);
+  std::vector<uint8_t> masks(samples);
+  uint8_t frame[BINARY_FRAME_LENGTH];
+
+  encodeBinaryPreamble(stream.data(), 0, TEST_REF, planCode);
+  for (uint32_t timecode = 0; timecode < samples; timecode++)
+  {
+    // Wie ADC_PLAN_MASK in AdcScheduler.h, der Zyklus beginnt bei Timecode 0.
+    uint8_t channels = 0;
+    for (uint8_t ch = 0; ch < 3; ch++)
+    {
+      if (dividers[ch] && !(timecode & (dividers[ch] - 1))) channels |= 1 << ch;
+    }
+    uint16_t values[4] = {TEST_REF, testValue(timecode, 0), testValue(timecode, 1),
+                          testValue(timecode, 2)};
+    uint8_t len = encodeBinaryPlanFrame(frame, timecode, values, channels, planCode);
+    stream.insert(stream.end(), frame, frame + len);
+    masks[timecode] = channels;
+  }
+
+  StreamReceiver<BinaryFrameDecoder> receiver;
+  uint32_t expected = 0;
+  uint32_t wrong = 0;
+  for (size_t pos = 0; pos < stream.size(); pos += TEST_CHUNK)
+  {
+    size_t len = std::min(TEST_CHUNK, stream.size() - pos);
+    receiver.feed(stream.data() + pos, len, [&](const TimedSample &sample)
+    {
+      uint8_t channels = expected < samples ? masks[expected] : 0;
+      if (sample.time != expected || sample.ref != TEST_REF || sample.channels != channels ||
+          ((channels & 1) && sample.ch1 != testValue(expected, 0)) ||
+          ((channels & 2) && sample.ch2 != testValue(expected, 1)) ||
+          ((channels & 4) && sample.ch3 != testValue(expected, 2)))
+      {
+        wrong++;
+      }
+      expected++;
+    });
+  }
+
+  ReceiverStats stats = receiver.stats();
+  bool ok = expected == samples && !wrong && stats.frames == samples && !stats.corrupted &&
+            !stats.skippedBytes && !stats.dropped && !stats.duplicated && !stats.restarts &&
+            receiver.planCode() == planCode;
+  printf("Ch1 %u Ch2 %u Ch3 %u: %u von %u Messungen, falsch: %u, fehlerhaft: %llu, "
+         "verworfene Bytes: %llu, fehlend: %llu %s\n",
+         dividers[0], dividers[1], dividers[2], expected, samples, wrong,
+         (unsigned long long)stats.corrupted, (unsigned long long)stats.skippedBytes,
+         (unsigned long long)stats.dropped, ok ? "OK" : "FEHLER");
+  return ok;
+}
+
+int main(int argc, char **argv)
+{
+  static const uint8_t dividerValues[] = {0, 1, 2, 4};
+  uint32_t samples = 70000;      // Mehr als 2^16, damit auch Bit 16..23 des Timecodes wechseln.
+  bool ok = true;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) samples = strtoul(argv[++i], nullptr, 10);
+  }
+
+  for (uint8_t ch1 : dividerValues)
+  {
+    for (uint8_t ch2 : dividerValues)
+    {
+      for (uint8_t ch3 : dividerValues)
+      {
+        if (ch1 != 1 && ch2 != 1 && ch3 != 1) continue;
+        uint8_t dividers[3] = {ch1, ch2, ch3};
+        ok &= testPlan(dividers, samples);
+      }
+    }
+  }
+  if (ok) printf("Alle Kanalplne OK\n");
+  else    printf("FEHLER: Nicht alle Kanalplne wurden vollstndig decodiert.\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,580 @@
+/*
+****************************************************************************************************
+CRASHPROFILE: Laufzeitmessung der Crashwagerl Firmware im Simulator (simavr).
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Ldt die mit PROFILE_STAGES 1 bersetzte Firmware (Crashwagerl.elf) in simavr und lsst sie
+       die angegebene Zeit laufen. Dabei werden mitgeschrieben:
+       - Die Schreibzugriffe auf GPIOR0 (Abschnitt von main()) und GPIOR1 (aktive ISRs) mit dem
+         Zyklenzhler (s. Profiling.h). Daraus werden die Zyklen pro Abschnitt und Messung
+         berechnet.
+       - Die Flanken am MILLISEC_PIN (PB0). Daraus werden Periode und Jitter berechnet.
+       - Die Flanken am UART Pin (PB1). Diese werden mit UART_TIMER_CYCLES Zyklen pro Bit als
+         8N1 decodiert, fehlerhafte Stoppbits werden gezhlt. simavr hat kein USI, der 3-Wire
+         Modus mit dem Compare Match von Timer 0 als Takt wird deshalb hier nachgebildet.
+       An den ADC Eingngen kann ein Signal vorgegeben werden (konstant, Sprung, Rauschen oder
+       eine Rampe ber den ganzen Messbereich, die in 2 mV Schritten alle Werte des ADC erreicht).
+       Die empfangenen Nachrichten (nur base64 Format) werden decodiert, Mittelwert und
+       Standardabweichung jedes Kanals werden in LSB eines 10 Bit Wertes ausgegeben. So kann
+       z. B. die Wirkung von ADC_OVERSAMPLING_LOG4 auf das Rauschen gemessen werden.
+
+       Das Programm liefert 1, wenn eine Messung mehr Zyklen braucht als ein Intervall hat, der
+       Jitter der Periode grer als die Toleranz ist oder ein UART Frame fehlerhaft ist. Damit
+       kann es nach jeder nderung der Firmware aufgerufen werden.
+       Mit -k liefert es auch 1, wenn Codieren oder Senden nicht in jeder Messung gleich viele
+       Zyklen brauchen. Verglichen werden nur Messungen, in denen dabei keine ISR aufgerufen
+       wurde. Mit -w sweep -t 2000 wird so geprft, dass die Zyklen nicht vom Messwert abhngen
+       (base64 Format ohne BURST_MODE, s. encodeBase64Frame).
+
+       Aufruf:       crashprofile [-r rate] [-t ms] [-j zyklen] [-w const|step|noise|sweep]
+                                  [-n mV] [-b bits] [-k] firmware.elf
+                     -r: SAMPLE_RATE_HZ der Firmware (Standard 1000)
+                     -t: Simulierte Zeit in ms (Standard 1000)
+                     -j: Erlaubte Abweichung der Periode in Zyklen (Standard 64, ein Timerschritt)
+                     -w: Signal an den ADC Eingngen (Standard const)
+                     -n: Amplitude des Rauschens bei -w noise (Standard 50 mV, gleichverteilt)
+                     -b: ADC_RESULT_BITS der Firmware (Standard 10)
+                     -k: Konstante Zyklen fr Codieren und Senden verlangen
+       bersetzen:   gcc -O2 -o crashprofile crashprofile.c -lsimavr -lelf -lm
+****************************************************************************************************
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_adc.h>
+
+#define F_CPU             7372800ul
+#define UART_TIMER_CYCLES 16
+#define GPIOR0_ADDR       (0x11 + 0x20)     // Datenadresse beim ATtiny45
+#define GPIOR1_ADDR       (0x12 + 0x20)
+#define USICR_ADDR        (0x0D + 0x20)
+#define USISR_ADDR        (0x0E + 0x20)
+#define USIDR_ADDR        (0x0F + 0x20)
+#define PINB_ADDR         (0x16 + 0x20)
+#define PORTB_ADDR        (0x18 + 0x20)
+#define USIOIF            6
+#define USIOIE            6
+#define USI_WIRE_MASK     (0b11 << 4)              // USIWM1:0
+#define USI_WIRE_3        (0b01 << 4)
+#define USI_CLOCK_MASK    (0b111 << 1)             // USICS1:0, USICLK
+#define USI_CLOCK_TIMER0  (0b010 << 1)             // Compare Match von Timer 0
+#define TIM0_COMPA_VECTOR 10
+#define USI_OVF_VECTOR    14
+#define STAGE_COUNT       3                 // PROFILE_WAIT, PROFILE_ENCODE, PROFILE_SEND
+#define ISR_COUNT         3                 // PROFILE_ISR_TIMER1, _ADC, _USI
+
+static const char *stageNames[STAGE_COUNT] = {"Warten", "Codieren", "Senden"};
+static const char *isrNames[ISR_COUNT] = {"ISR Timer1", "ISR ADC", "ISR USI"};
+
+typedef enum {SIGNAL_CONST, SIGNAL_STEP, SIGNAL_NOISE, SIGNAL_SWEEP} SIGNALS;
+
+// Einfache Statistik mit Mittelwert, Minimum, Maximum und Standardabweichung.
+typedef struct
+{
+  uint64_t count;
+  double sum;
+  double sumSquares;
+  double min;
+  double max;
+} STATISTIC;
+
+static avr_t *avr;
+static SIGNALS signalType = SIGNAL_CONST;
+static int noiseMillivolts = 50;
+static unsigned resultBits = 10;
+static uint32_t sweepMillivolts = 0;            // Fortschritt der Rampe bei -w sweep
+
+// Zustand der Abschnittsmessung
+static uint8_t currentStage = 0;
+static uint8_t activeIsrs = 0;
+static avr_cycle_count_t lastEventCycle = 0;
+static uint64_t stageCycles[STAGE_COUNT];       // Zyklen seit dem letzten Sampletakt
+static uint64_t isrCycles[ISR_COUNT];
+static STATISTIC stageStats[STAGE_COUNT];
+static STATISTIC isrStats[ISR_COUNT];
+static STATISTIC busyStats;                     // Alle Zyklen auer Warten
+static int stageDisturbed = 0;                  // ISR whrend Codieren oder Senden
+static STATISTIC constantStats[STAGE_COUNT];    // Nur Messungen ohne ISR beim Codieren/Senden
+
+// Zustand der Periodenmessung
+static avr_cycle_count_t lastTickCycle = 0;
+static STATISTIC periodStats;
+
+// USI Overflow Interrupt. Das Flag wird nicht beim Aufruf der ISR gelscht, sondern von ihr.
+static avr_int_vector_t usiOverflow =
+{
+  .vector = USI_OVF_VECTOR,
+  .enable = AVR_IO_REGBIT(USICR_ADDR, USIOIE),
+  .raised = AVR_IO_REGBIT(USISR_ADDR, USIOIF),
+  .raise_sticky = 1
+};
+
+// Zustand des UART Decoders
+static int uartLevel = 1;
+static int uartBit = -1;                        // -1: Idle, 0: Startbit, 1..8: Daten, 9: Stopp
+static avr_cycle_count_t uartStartCycle;
+static uint8_t uartByte;
+static uint64_t uartBytes = 0;
+static uint64_t uartFramingErrors = 0;
+
+// Zustand des Nachrichtendecoders
+static char line[14];
+static unsigned lineLength = 0;
+static STATISTIC channelStats[3];
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Nimmt einen Wert in die Statistik auf.
+* @param statPtr: Statistik.
+* @param val: Wert.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void statAdd(STATISTIC *statPtr, double val)
+{
+  if (!statPtr->count || val < statPtr->min) statPtr->min = val;
+  if (!statPtr->count || val > statPtr->max) statPtr->max = val;
+  statPtr->count++;
+  statPtr->sum += val;
+  statPtr->sumSquares += val * val;
+}
+
+static double statMean(const STATISTIC *statPtr)
+{
+  return statPtr->count ? statPtr->sum / statPtr->count : 0;
+}
+
+static double statStdDev(const STATISTIC *statPtr)
+{
+  double mean = statMean(statPtr);
+  return statPtr->count ? sqrt(statPtr->sumSquares / statPtr->count - mean * mean) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Ordnet die Zyklen seit dem letzten Ereignis der aktiven ISR (die mit dem hchsten Bit, da sie
+* die anderen unterbrochen hat) oder dem aktuellen Abschnitt von main() zu.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void accountCycles()
+{
+  uint64_t cycles = avr->cycle - lastEventCycle;
+  int isr;
+
+  lastEventCycle = avr->cycle;
+  for (isr = ISR_COUNT - 1; isr >= 0; isr--)
+  {
+    if (activeIsrs & (1 << isr))
+    {
+      isrCycles[isr] += cycles;
+      return;
+    }
+  }
+  if (currentStage < STAGE_COUNT) stageCycles[currentStage] += cycles;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wird bei jedem Schreibzugriff auf GPIOR0 und GPIOR1 aufgerufen. Der Wert muss selbst in den
+* Speicher geschrieben werden, da simavr das bei registrierten Callbacks nicht macht.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onGpiorWrite(struct avr_t *avrPtr, avr_io_addr_t addr, uint8_t val, void *param)
+{
+  (void)param;
+  accountCycles();
+  avrPtr->data[addr] = val;
+  if (addr == GPIOR0_ADDR)
+  {
+    currentStage = val;
+  }
+  else
+  {
+    // Die Zyklen fr den Eintritt in die ISR zhlen noch zum Abschnitt von main().
+    if ((val & ~activeIsrs) && currentStage != 0) stageDisturbed = 1;
+    activeIsrs = val;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wird bei jeder Flanke am MILLISEC_PIN aufgerufen. Jede Flanke ist eine Messung, die Zyklen der
+* vorigen Messung werden in die Statistik bernommen.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onTick(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  uint64_t busy = 0;
+  int i;
+
+  (void)irq; (void)value; (void)param;
+  accountCycles();
+  if (lastTickCycle)
+  {
+    statAdd(&periodStats, (double)(avr->cycle - lastTickCycle));
+    for (i = 0; i < STAGE_COUNT; i++)
+    {
+      statAdd(&stageStats[i], (double)stageCycles[i]);
+      if (!stageDisturbed) statAdd(&constantStats[i], (double)stageCycles[i]);
+      if (i != 0) busy += stageCycles[i];
+    }
+    for (i = 0; i < ISR_COUNT; i++)
+    {
+      statAdd(&isrStats[i], (double)isrCycles[i]);
+      busy += isrCycles[i];
+    }
+    statAdd(&busyStats, (double)busy);
+  }
+  memset(stageCycles, 0, sizeof(stageCycles));
+  memset(isrCycles, 0, sizeof(isrCycles));
+  stageDisturbed = 0;
+  lastTickCycle = avr->cycle;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Setzt die empfangenen Bytes zu Zeilen zusammen und nimmt die Kanle jeder gltigen base64
+* Nachricht in die Statistik auf, umgerechnet auf 10 Bit.
+* @param val: Empfangenes Byte.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onUartByte(uint8_t val)
+{
+  static const char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  int values[3];
+  int invalid = 0;
+  int i;
+
+  if (val != '\n')
+  {
+    if (lineLength < sizeof(line)) line[lineLength] = (char)val;
+    lineLength++;
+    return;
+  }
+  if (lineLength == 13 && line[12] == '\r')
+  {
+    for (i = 0; i < 6; i++)
+    {
+      const char *charPtr = line[6 + i] ? strchr(alphabet, line[6 + i]) : NULL;
+      if (!charPtr)
+      {
+        invalid = 1;
+        break;
+      }
+      if (i % 2) values[i / 2] = values[i / 2] * 64 + (int)(charPtr - alphabet);
+      else       values[i / 2] = (int)(charPtr - alphabet);
+    }
+    for (i = 0; i < 3 && !invalid; i++)
+    {
+      statAdd(&channelStats[i], values[i] / (double)(1 << (resultBits - 10)));
+    }
+  }
+  lineLength = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Tastet den UART Pin bis zum bergebenen Zyklus ab. Abgetastet wird in der Mitte jedes Bits,
+* bis dahin gilt der Pegel der letzten Flanke.
+* @param untilCycle: Zyklus der neuen Flanke.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void uartSampleUntil(avr_cycle_count_t untilCycle)
+{
+  while (uartBit >= 0)
+  {
+    avr_cycle_count_t sampleCycle = uartStartCycle + uartBit * UART_TIMER_CYCLES +
+                                    UART_TIMER_CYCLES / 2;
+    if (sampleCycle >= untilCycle) return;
+    if (uartBit == 0 && uartLevel)
+    {
+      uartBit = -1;                    // Strimpuls, kein Startbit
+      return;
+    }
+    if (uartBit >= 1 && uartBit <= 8)
+    {
+      uartByte = (uartByte >> 1) | (uartLevel ? 0x80 : 0);
+    }
+    if (uartBit == 9)
+    {
+      if (uartLevel)
+      {
+        uartBytes++;
+        onUartByte(uartByte);
+      }
+      else
+      {
+        uartFramingErrors++;
+      }
+      uartBit = -1;
+      return;
+    }
+    uartBit++;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Bestimmt den Pegel am UART Pin nach einer nderung von USI oder PORTB und gibt Flanken an den
+* Decoder weiter. Im 3-Wire Modus liegt das MSB des USIDR am Pin, sonst PORTB.
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void updateUartPin()
+{
+  int level;
+
+  if ((avr->data[USICR_ADDR] & USI_WIRE_MASK) == USI_WIRE_3) level = avr->data[USIDR_ADDR] >> 7;
+  else level = (avr->data[PORTB_ADDR] >> 1) & 1;
+  if (level == uartLevel) return;
+  uartSampleUntil(avr->cycle);
+  if (uartBit < 0 && uartLevel && !level)
+  {
+    uartStartCycle = avr->cycle;       // Fallende Flanke im Idle: Startbit
+    uartBit = 0;
+  }
+  uartLevel = level;
+}
+
+static void onPortPin(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  (void)irq; (void)value; (void)param;
+  updateUartPin();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Schreibzugriff auf die USI Register. Beim USISR lscht eine 1 das Flag, der Zhler wird gesetzt.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onUsiWrite(struct avr_t *avrPtr, avr_io_addr_t addr, uint8_t val, void *param)
+{
+  (void)param;
+  if (addr == USISR_ADDR)
+  {
+    if (val & (1 << USIOIF)) avr_clear_interrupt(avrPtr, &usiOverflow);
+    val = (avrPtr->data[USISR_ADDR] & 0xF0 & ~(val & 0xE0)) | (val & 0x0F);
+  }
+  avrPtr->data[addr] = val;
+  updateUartPin();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wird bei jedem Compare Match A von Timer 0 aufgerufen (auch ohne freigegebenen Interrupt) und
+* taktet das USI: USIDR schieben (DI ist PB0), Zhler erhhen, beim berlauf den Interrupt auslsen.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onTimer0Compare(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  uint8_t count;
+
+  (void)irq; (void)param;
+  if (!value || (avr->data[USICR_ADDR] & USI_CLOCK_MASK) != USI_CLOCK_TIMER0) return;
+  avr->data[USIDR_ADDR] = (uint8_t)(avr->data[USIDR_ADDR] << 1) | (avr->data[PINB_ADDR] & 1);
+  count = (avr->data[USISR_ADDR] + 1) & 0x0F;
+  avr->data[USISR_ADDR] = (avr->data[USISR_ADDR] & 0xF0) | count;
+  if (!count) avr_raise_interrupt(avr, &usiOverflow);
+  updateUartPin();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Wird beim Start einer Wandlung aufgerufen und legt die Spannung (in mV) an die Eingnge.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static void onAdcTrigger(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  static const int adcIrqs[3] = {ADC_IRQ_ADC1, ADC_IRQ_ADC3, ADC_IRQ_ADC2};   // PB2, PB3, PB4
+  double seconds = (double)avr->cycle / F_CPU;
+  uint32_t millivolts;
+  int i;
+
+  (void)irq; (void)value; (void)param;
+  for (i = 0; i < 3; i++)
+  {
+    switch (signalType)
+    {
+      case SIGNAL_STEP:  millivolts = seconds < 0.5 ? 1000 : 4000; break;
+      case SIGNAL_NOISE: millivolts = 2500 + rand() % (2 * noiseMillivolts + 1) - noiseMillivolts;
+                         break;
+      case SIGNAL_SWEEP: millivolts = (sweepMillivolts + 1667 * i) % 5000; break;
+      default:           millivolts = 1000 + 1000 * i; break;
+    }
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, adcIrqs[i]), millivolts);
+  }
+  sweepMillivolts += 2;              // Kleiner als 1 LSB (4.9 mV bei 10 Bit)
+}
+
+static void printStat(const char *name, const STATISTIC *statPtr)
+{
+  printf("%-12s %10.1f %10.0f %10.0f %10.1f\n", name, statMean(statPtr), statPtr->min,
+         statPtr->max, statStdDev(statPtr));
+}
+
+int main(int argc, char **argv)
+{
+  elf_firmware_t firmware;
+  unsigned long sampleRate = 1000;
+  unsigned long milliseconds = 1000;
+  double jitterTolerance = 64;
+  double cyclesPerSample;
+  avr_cycle_count_t endCycle;
+  int state = cpu_Running;
+  int requireConstant = 0;
+  int failed = 0;
+  int option;
+  int i;
+
+  while ((option = getopt(argc, argv, "r:t:j:w:n:b:k")) != -1)
+  {
+    switch (option)
+    {
+      case 'r': sampleRate = strtoul(optarg, NULL, 10); break;
+      case 't': milliseconds = strtoul(optarg, NULL, 10); break;
+      case 'j': jitterTolerance = atof(optarg); break;
+      case 'w':
+        if      (!strcmp(optarg, "step"))  signalType = SIGNAL_STEP;
+        else if (!strcmp(optarg, "noise")) signalType = SIGNAL_NOISE;
+        else if (!strcmp(optarg, "sweep")) signalType = SIGNAL_SWEEP;
+        break;
+      case 'n': noiseMillivolts = atoi(optarg); break;
+      case 'b': resultBits = strtoul(optarg, NULL, 10); break;
+      case 'k': requireConstant = 1; break;
+      default:
+        fprintf(stderr, "Aufruf: %s [-r rate] [-t ms] [-j zyklen] [-w const|step|noise|sweep] "
+                        "[-n mV] [-b bits] [-k] firmware.elf\n", argv[0]);
+        return 2;
+    }
+  }
+  if (optind >= argc)
+  {
+    fprintf(stderr, "Keine Firmware angegeben.\n");
+    return 2;
+  }
+
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[optind], &firmware) != 0)
+  {
+    fprintf(stderr, "%s kann nicht gelesen werden.\n", argv[optind]);
+    return 2;
+  }
+  avr = avr_make_mcu_by_name("attiny45");
+  if (!avr)
+  {
+    fprintf(stderr, "simavr untersttzt den attiny45 nicht.\n");
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = F_CPU;
+  avr->vcc = avr->avcc = avr->aref = 5000;
+
+  avr_register_io_write(avr, GPIOR0_ADDR, onGpiorWrite, NULL);
+  avr_register_io_write(avr, GPIOR1_ADDR, onGpiorWrite, NULL);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), IOPORT_IRQ_PIN0),
+                          onTick, NULL);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), IOPORT_IRQ_PIN1),
+                          onPortPin, NULL);
+  avr_register_vector(avr, &usiOverflow);
+  avr_register_io_write(avr, USICR_ADDR, onUsiWrite, NULL);
+  avr_register_io_write(avr, USISR_ADDR, onUsiWrite, NULL);
+  avr_register_io_write(avr, USIDR_ADDR, onUsiWrite, NULL);
+  avr_irq_register_notify(avr_get_interrupt_irq(avr, TIM0_COMPA_VECTOR) + AVR_INT_IRQ_PENDING,
+                          onTimer0Compare, NULL);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_OUT_TRIGGER),
+                          onAdcTrigger, NULL);
+
+  endCycle = (avr_cycle_count_t)F_CPU * milliseconds / 1000;
+  while (state != cpu_Done && state != cpu_Crashed && avr->cycle < endCycle)
+  {
+    state = avr_run(avr);
+  }
+  uartSampleUntil(avr->cycle);
+
+  cyclesPerSample = (double)F_CPU / sampleRate;
+  printf("Messungen: %llu, Sollperiode: %.1f Zyklen\n\n", (unsigned long long)periodStats.count,
+         cyclesPerSample);
+  printf("%-12s %10s %10s %10s %10s\n", "Zyklen", "Mittel", "Min", "Max", "StdAbw");
+  for (i = 0; i < STAGE_COUNT; i++) printStat(stageNames[i], &stageStats[i]);
+  for (i = 0; i < ISR_COUNT; i++) printStat(isrNames[i], &isrStats[i]);
+  printStat("Belegt", &busyStats);
+  printStat("Periode", &periodStats);
+  if (requireConstant)
+  {
+    printf("\nOhne ISR (%llu Messungen):\n", (unsigned long long)constantStats[0].count);
+    for (i = 1; i < STAGE_COUNT; i++) printStat(stageNames[i], &constantStats[i]);
+  }
+  printf("\nUART: %llu Bytes, %llu Framingfehler\n", (unsigned long long)uartBytes,
+         (unsigned long long)uartFramingErrors);
+  if (channelStats[0].count)
+  {
+    printf("\n%-12s %10s %10s %10s %10s\n", "10 Bit LSB", "Mittel", "Min", "Max", "StdAbw");
+    printStat("Kanal 1", &channelStats[0]);
+    printStat("Kanal 2", &channelStats[1]);
+    printStat("Kanal 3", &channelStats[2]);
+  }
+
+  if (state == cpu_Crashed)
+  {
+    printf("FEHLER: Die Firmware ist abgestrzt.\n");
+    failed = 1;
+  }
+  if (!periodStats.count)
+  {
+    printf("FEHLER: Kein Sampletakt am MILLISEC_PIN.\n");
+    failed = 1;
+  }
+  if (busyStats.max > cyclesPerSample)
+  {
+    printf("FEHLER: Eine Messung braucht %.0f von %.1f Zyklen.\n", busyStats.max, cyclesPerSample);
+    failed = 1;
+  }
+  if (periodStats.count && (periodStats.max - cyclesPerSample > jitterTolerance ||
+                            cyclesPerSample - periodStats.min > jitterTolerance))
+  {
+    printf("FEHLER: Die Periode weicht mehr als %.0f Zyklen ab.\n", jitterTolerance);
+    failed = 1;
+  }
+  if (requireConstant)
+  {
+    if (!constantStats[0].count)
+    {
+      printf("FEHLER: Keine Messung ohne ISR beim Codieren und Senden.\n");
+      failed = 1;
+    }
+    for (i = 1; i < STAGE_COUNT; i++)
+    {
+      if (constantStats[i].max != constantStats[i].min)
+      {
+        printf("FEHLER: %s braucht %.0f bis %.0f Zyklen.\n", stageNames[i], constantStats[i].min,
+               constantStats[i].max);
+        failed = 1;
+      }
+    }
+    if (signalType == SIGNAL_SWEEP && sweepMillivolts < 5000)
+    {
+      printf("FEHLER: Die Rampe hat nicht den ganzen Messbereich erreicht (-t erhhen).\n");
+      failed = 1;
+    }
+  }
+  if (uartFramingErrors)
+  {
+    printf("FEHLER: Fehlerhafte UART Frames.\n");
+    failed = 1;
+  }
+  return failed;
+}
@@ -0,0 +1,184 @@
+/*
+****************************************************************************************************
+CRASHPYRAMID: bersichtsindex fr lange Aufzeichnungen erstellen und abfragen (POSIX).
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Hat 3 Aufgaben (s. PyramidIndex.h):
+         - Mit -o werden Rohdaten (wie bei crashdecode) in eine Aufzeichnung mit Spalten und
+           pyramid.bin gewandelt. Die Rohdaten werden dabei nur einmal gelesen.
+         - Mit -i wird pyramid.bin fr eine vorhandene Aufzeichnung ohne Index erstellt.
+         - Sonst wird eine Aufzeichnung abgefragt: Der Zeitbereich wird in gleich breite Pixel
+           geteilt und pro Pixel eine Zeile
+             Zeit;Zeilen;Ch1 Min;Ch1 Mittel;Ch1 Max;Ch2 Min;...;Ch3 Max
+           auf stdout geschrieben. Die Zeit ist die des ersten Messwerts im Pixel, Kanle ohne
+           Wert bleiben leer. Gelesen werden nur O(Pixel) Eintrge des Index, auch bei einer
+           Aufzeichnung ber viele Stunden.
+
+       Aufruf:       crashpyramid [-b|-d] -o verzeichnis [datei]
+                     crashpyramid -i verzeichnis
+                     crashpyramid [-p pixel] [-f von] [-t bis] verzeichnis
+                     -b, -d: Binr- bzw. Deltaformat, sonst base64.
+                     -p:     Anzahl der Pixel (Standard 1000).
+                     -f, -t: Zeitbereich in Messungen (Standard die ganze Aufzeichnung).
+       bersetzen:   g++ -O2 -std=c++17 -o crashpyramid crashpyramid.cpp
+****************************************************************************************************
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "CaptureFile.h"
+#include "CrashwagerlReceiver.h"
+#include "PyramidIndex.h"
+
+using namespace crashwagerl;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Decodiert die Rohdaten und schreibt Spalten und Index.
+* @param file: Geffnete Datei.
+* @param directory: Verzeichnis der neuen Aufzeichnung.
+* @return Exit Code.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+template <class Decoder>
+static int convert(FILE *file, const std::string &directory)
+{
+  StreamReceiver<Decoder> receiver;
+  CaptureFile capture;
+  PyramidWriter pyramid;
+  uint8_t buffer[65536];
+  bool failed = false;
+  size_t len;
+
+  if (!capture.open(directory) || !pyramid.open(directory)) return 1;
+  while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    receiver.feed(buffer, len, [&](const TimedSample &sample)
+    {
+      if (!failed && (!capture.append(sample) || !pyramid.append(sample))) failed = true;
+    });
+  }
+  capture.close();
+  pyramid.close();
+
+  ReceiverStats stats = receiver.stats();
+  fprintf(stderr, "Nachrichten: %llu, fehlerhaft: %llu, fehlend: %llu\n",
+          (unsigned long long)stats.frames, (unsigned long long)stats.corrupted,
+          (unsigned long long)stats.dropped);
+  return failed ? 1 : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Erstellt pyramid.bin aus den Spalten einer vorhandenen Aufzeichnung.
+* @param directory: Verzeichnis der Aufzeichnung.
+* @return Exit Code.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static int buildIndex(const std::string &directory)
+{
+  ReadOnlyColumn<uint64_t> time;
+  ReadOnlyColumn<uint16_t> ch1, ch2, ch3;
+  PyramidWriter pyramid;
+
+  if (!time.open(directory + "/time.u64") || !ch1.open(directory + "/ch1.u16") ||
+      !ch2.open(directory + "/ch2.u16") || !ch3.open(directory + "/ch3.u16") ||
+      !pyramid.open(directory))
+  {
+    return 1;
+  }
+  for (size_t row = 0; row < time.size(); row++)
+  {
+    TimedSample sample{time[row], 0, ch1[row], ch2[row], ch3[row], 0};
+    sample.channels = (ch1[row] != CAPTURE_NO_VALUE) | (ch2[row] != CAPTURE_NO_VALUE) << 1 |
+                      (ch3[row] != CAPTURE_NO_VALUE) << 2;
+    if (!pyramid.append(sample)) return 1;
+  }
+  pyramid.close();
+  fprintf(stderr, "Zeilen: %zu, Eintrge: %zu\n", time.size(),
+          pyramidEntries(time.size() >> PYRAMID_BASE_LOG2));
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Gibt den Zeitbereich [from, to) mit pixels Zeilen aus.
+* @return Exit Code.
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static int query(const std::string &directory, uint64_t from, uint64_t to, size_t pixels)
+{
+  PyramidReader reader;
+
+  if (!reader.open(directory)) return 1;
+  size_t begin = reader.rowAtTime(from);
+  size_t end = reader.rowAtTime(to);
+  reader.query(begin, end, pixels, [&](size_t first, size_t last, const PyramidEntry &entry)
+  {
+    printf("%llu;%zu", (unsigned long long)reader.timeAtRow(first), last - first);
+    for (const PyramidChannel &channel : entry.channels)
+    {
+      if (channel.count) printf(";%u;%.2f;%u", channel.min, channel.mean, channel.max);
+      else               printf(";;;");
+    }
+    putchar('\n');
+  });
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int format = FRAME_FORMAT_BASE64;
+  const char *outputDirectory = nullptr;
+  const char *indexDirectory = nullptr;
+  const char *name = nullptr;
+  uint64_t from = 0;
+  uint64_t to = UINT64_MAX;
+  size_t pixels = 1000;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-b") == 0) format = FRAME_FORMAT_BINARY;
+    else if (strcmp(argv[i], "-d") == 0) format = FRAME_FORMAT_DELTA;
+    else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) outputDirectory = argv[++i];
+    else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) indexDirectory = argv[++i];
+    else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) pixels = strtoull(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) from = strtoull(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) to = strtoull(argv[++i], nullptr, 10);
+    else if (argv[i][0] != '-') name = argv[i];
+    else
+    {
+      fprintf(stderr, "Aufruf: crashpyramid [-b|-d] -o verzeichnis [datei]\n"
+                      "        crashpyramid -i verzeichnis\n"
+                      "        crashpyramid [-p pixel] [-f von] [-t bis] verzeichnis\n");
+      return 2;
+    }
+  }
+
+  if (indexDirectory) return buildIndex(indexDirectory);
+  if (!outputDirectory)
+  {
+    if (!name)
+    {
+      fprintf(stderr, "Keine Aufzeichnung angegeben.\n");
+      return 2;
+    }
+    return query(name, from, to, pixels);
+  }
+
+  FILE *file = stdin;
+  int result;
+  if (name && !(file = fopen(name, "rb")))
+  {
+    perror(name);
+    return 1;
+  }
+  if (format == FRAME_FORMAT_BINARY) result = convert<BinaryFrameDecoder>(file, outputDirectory);
+  else if (format == FRAME_FORMAT_DELTA) result = convert<DeltaFrameDecoder>(file, outputDirectory);
+  else result = convert<Base64FrameDecoder>(file, outputDirectory);
+  if (file != stdin) fclose(file);
+  return result;
+}
@@ -0,0 +1,90 @@
+/*
+****************************************************************************************************
+CRASHSIM: Lsst die Crashwagerl Firmware am PC laufen.
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  bersetzt Crashwagerl.c mit dem Mock Backend aus HostBackend.h (s. Crashwagerl/Hal.h) und
+       fhrt main() fr die angegebene Anzahl an Messungen aus. Die Einstellungen (FRAME_FORMAT,
+       Kanalplan, BURST_MODE, ...) kommen wie am Chip aus Crashwagerl.h. Die Bytes, die das USI
+       gesendet htte, werden in die Ausgabedatei geschrieben und knnen z. B. direkt mit
+       crashdecode geprft werden:
+                     crashsim -n 10000 -w ramp | crashdecode -b
+       Auf stderr werden die Anzahl der Bytes und der Frames mit falschem Start- oder Stoppbit
+       ausgegeben. Das Programm liefert 1, wenn ein Frame fehlerhaft ist.
+
+       Aufruf:       crashsim [-n messungen] [-w const|ramp|sine|noise] [-o datei]
+                     -n: Anzahl der Messungen (Standard 1000)
+                     -w: Signal an den ADC Eingngen (Standard sine)
+                     -o: Ausgabedatei (Standard stdout)
+       bersetzen:   gcc -O2 -o crashsim crashsim.c -lm
+****************************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// main() der Firmware umbenennen, damit es hier aufgerufen werden kann.
+#define main firmwareMain
+#include "../Crashwagerl/Crashwagerl.c"
+#undef main
+
+// Fhrt main() der Firmware aus. waitForAdcFrame springt nach der letzten Messung hierher zurck.
+static void runFirmware()
+{
+  if (!setjmp(hostExit)) firmwareMain();
+}
+
+int main(int argc, char *argv[])
+{
+  const char *outputName = NULL;
+  FILE *output = stdout;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:w:o:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        hostSamplesLeft = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'w':
+        if (!strcmp(optarg, "const")) hostSignal = HOST_SIGNAL_CONST;
+        else if (!strcmp(optarg, "ramp")) hostSignal = HOST_SIGNAL_RAMP;
+        else if (!strcmp(optarg, "sine")) hostSignal = HOST_SIGNAL_SINE;
+        else if (!strcmp(optarg, "noise")) hostSignal = HOST_SIGNAL_NOISE;
+        else
+        {
+          fprintf(stderr, "Unbekanntes Signal %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'o':
+        outputName = optarg;
+        break;
+      default:
+        fprintf(stderr, "Aufruf: crashsim [-n messungen] [-w const|ramp|sine|noise] [-o datei]\n");
+        return 2;
+    }
+  }
+
+  runFirmware();
+
+  if (outputName && !(output = fopen(outputName, "wb")))
+  {
+    perror(outputName);
+    return 2;
+  }
+  if (fwrite(hostCapture, 1, hostCaptureLength, output) != hostCaptureLength)
+  {
+    perror("fwrite");
+    return 2;
+  }
+  if (output != stdout) fclose(output);
+
+  fprintf(stderr, "Messungen: %u, Bytes: %zu, Frame Fehler: %u\n", (unsigned)hostTick,
+          hostCaptureLength, (unsigned)hostFrameErrors);
+  free(hostCapture);
+  return hostFrameErrors ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+/*
+****************************************************************************************************
+ENCODEBENCH: Vergleicht die Codierung der Nachrichten am PC.
+
+Autor: Michael Schletz, 21. November 2016
+Desc:  Ruft die Funktionen der Firmware (Crashwagerl.h und FrameFormat.h, beide ohne AVR
+       Header) fr jede Messung einer synthetischen Aufzeichnung auf und gibt pro Nachricht die
+       Zeit in ns und die Anzahl der x86 Befehle (perf_event_open, sonst n/a) aus. Neben den
+       Formaten der Firmware werden Varianten mit Tabelle gemessen:
+       - base64:        uint32ToBase64 und uint16ToBase64 mit der Vergleichskette, danach
+                        reverseByte fr jedes Byte (wie uartSendMessage)
+       - base64 Tabelle: encodeBase64Frame der Firmware, die schon umgedrehten Zeichen kommen
+                        aus base64ReversedTable
+       - binr, binr mit Kanalplan (Ch1 jede, Ch2 jede 2., Ch3 jede 4. Messung), delta
+       - reverseByte:   die 7 Bytes einer binren Nachricht wie im TxBuffer umdrehen, mit der
+                        Firmware Funktion bzw. einer Tabelle mit 256 Eintrgen
+       Jede Variante luft mehrmals, ausgegeben wird der schnellste Durchlauf. Die Prfsumme ber
+       alle Bytes verhindert, dass der Compiler die Codierung weglsst.
+       Die Befehle am PC sind nur ein Anhaltspunkt fr die Reihenfolge der Varianten. Die Zyklen
+       am ATtiny werden mit crashprofile im Simulator gemessen.
+
+       Aufruf:       encodebench [-n messungen] [-r wiederholungen]
+       bersetzen:   gcc -O2 -o encodebench encodebench.c -lm
+****************************************************************************************************
+*/
+
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../Crashwagerl/Crashwagerl.h"
+
+#define VALUE_COUNT 4096         // Lnge der synthetischen Aufzeichnung (2er Potenz)
+
+// Codiert die Messung timecode und liefert die Anzahl der Bytes.
+typedef uint8_t (*ENCODER)(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr);
+
+typedef struct
+{
+  const char *name;
+  ENCODER encode;
+} VARIANT;
+
+static uint16_t values[VALUE_COUNT][4];   // Ref, Ch1, Ch2, Ch3
+static DELTA_ENCODER deltaEncoder;
+static uint8_t reverseTable[256];
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Codiert eine bergebene 32bit Variable als ASCII base64 String. Dies Codierung ist allerdings
+* keine standardgeme base64 Codierung, da hier nicht auf 3 Bytes aufgefllt wird. Es wird im
+* Prinzip ins 64er System konvertiert und die Zeichentabelle der base64 Codierung verwendet.
+* @param val: Der zu codierende binre Wert.
+* @param bufferPtr: Pointer auf den Puffer, der den String speichern soll.
+* @param len: Lnge des base64 codierten Strings. Ist die Lnge kleiner als ein 32bit Wert haben
+*             kann (6 Zeichen), werden die niederwertigsten Bits genommen. Es knnen pro Zeichen
+*             6 Bits codiert werden (2^6 = 64)
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uint32ToBase64(uint32_t val, char *bufferPtr, uint8_t len)
+{
+  uint8_t byteToEncode;
+
+  bufferPtr += len;
+  while (len--)
+  {
+    --bufferPtr;
+    byteToEncode = val & 0b111111;
+    val >>= 6;
+    if (byteToEncode < 26)       *bufferPtr = 'A'+byteToEncode;
+    else if (byteToEncode < 52)  *bufferPtr = 'a'+(byteToEncode-26);
+    else if (byteToEncode < 62)  *bufferPtr = '0'+(byteToEncode-52);
+    else if (byteToEncode == 62) *bufferPtr = '+';
+    else if (byteToEncode == 63) *bufferPtr = '/';
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* Codiert eine bergebene 16bit Variable als ASCII base64 String. Dies Codierung ist allerdings
+* keine standardgeme base64 Codierung, da hier nicht auf 3 Bytes aufgefllt wird. Es wird im
+* Prinzip ins 64er System konvertiert und die Zeichentabelle der base64 Codierung verwendet.
+* @param val: Der zu codierende binre Wert.
+* @param bufferPtr: Pointer auf den Puffer, der den String speichern soll.
+* @param len: Lnge des base64 codierten Strings. Ist die Lnge kleiner als ein 16bit Wert haben
+*             kann (3 Zeichen), werden die niederwertigsten Bits genommen. Es knnen pro Zeichen
+*             6 Bits codiert werden (2^6 = 64)
+* @return void
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static inline void uint16ToBase64(uint16_t val, char *buffer, uint8_t len)
+{
+  uint8_t byteToEncode;
+
+  buffer += len;
+  while (len--)
+  {
+    --buffer;
+    byteToEncode = val & 0b111111;
+    val >>= 6;
+    if (byteToEncode < 26)       *buffer = 'A'+byteToEncode;
+    else if (byteToEncode < 52)  *buffer = 'a'+(byteToEncode-26);
+    else if (byteToEncode < 62)  *buffer = '0'+(byteToEncode-52);
+    else if (byteToEncode == 62) *buffer = '+';
+    else if (byteToEncode == 63) *buffer = '/';
+  }
+}
+
+static uint8_t encodeBase64(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  char message[BASE64_FRAME_LENGTH + 1] = "            \r\n";
+  uint8_t count;
+
+  uint32ToBase64(timecode, message, 4);
+  uint16ToBase64(valuesPtr[0], message+4, 2);
+  uint16ToBase64(valuesPtr[1], message+6, 2);
+  uint16ToBase64(valuesPtr[2], message+8, 2);
+  uint16ToBase64(valuesPtr[3], message+10, 2);
+  for (count = 0; message[count]; count++) bufferPtr[count] = reverseByte((uint8_t)message[count]);
+  return count;
+}
+
+static uint8_t encodeBase64Table(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  encodeBase64Frame(bufferPtr, timecode, valuesPtr);
+  return BASE64_FRAME_LENGTH;
+}
+
+static uint8_t encodeBinary(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  encodeBinaryFrame(bufferPtr, timecode, valuesPtr[0], valuesPtr[1], valuesPtr[2], valuesPtr[3]);
+  return 7;
+}
+
+static uint8_t encodeBinaryPlan(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  // Plancode fr Teiler 1, 2, 4 (s. PLAN_CODE in FrameFormat.h)
+  static const uint8_t planCode = (0 << 4) | (1 << 2) | 2;
+  uint8_t channels = 0b001 | (!(timecode & 1) << 1) | (!(timecode & 3) << 2);
+
+  return encodeBinaryPlanFrame(bufferPtr, timecode, valuesPtr, channels, planCode);
+}
+
+static uint8_t encodeDelta(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  return encodeDeltaSample(&deltaEncoder, bufferPtr, timecode, valuesPtr);
+}
+
+static uint8_t reverseFirmware(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  uint8_t frame[7];
+  uint8_t count;
+
+  encodeBinaryFrame(frame, timecode, valuesPtr[0], valuesPtr[1], valuesPtr[2], valuesPtr[3]);
+  for (count = 0; count < 7; count++) bufferPtr[count] = reverseByte(frame[count]);
+  return 7;
+}
+
+static uint8_t reverseLookup(uint32_t timecode, const uint16_t *valuesPtr, uint8_t *bufferPtr)
+{
+  uint8_t frame[7];
+  uint8_t count;
+
+  encodeBinaryFrame(frame, timecode, valuesPtr[0], valuesPtr[1], valuesPtr[2], valuesPtr[3]);
+  for (count = 0; count < 7; count++) bufferPtr[count] = reverseTable[frame[count]];
+  return 7;
+}
+
+static const VARIANT variants[] =
+{
+  {"base64", encodeBase64},
+  {"base64 Tabelle", encodeBase64Table},
+  {"binr", encodeBinary},
+  {"binr Kanalplan", encodeBinaryPlan},
+  {"delta", encodeDelta},
+  {"reverseByte", reverseFirmware},
+  {"reverseByte Tabelle", reverseLookup},
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+* ffnet einen Zhler fr die ausgefhrten Befehle im User Mode dieses Prozesses.
+* @return Filedeskriptor oder -1, wenn der Kernel es nicht erlaubt (perf_event_paranoid).
+*/
+////////////////////////////////////////////////////////////////////////////////////////////////////
+static int openInstructionCounter()
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static void initValues()
+{
+  uint32_t noise = 1;
+  uint32_t index;
+  uint8_t channel;
+
+  for (index = 0; index < VALUE_COUNT; index++)
+  {
+    values[index][0] = 341;
+    for (channel = 1; channel < 4; channel++)
+    {
+      noise = noise * 1103515245u + 12345u;
+      values[index][channel] = (uint16_t)(512 + lround(300.0 * sin(2.0 * M_PI * channel * index /
+                                          VALUE_COUNT)) + (int)((noise >> 16) & 7) - 4);
+    }
+  }
+  for (index = 0; index < 256; index++)
+  {
+    reverseTable[index] = reverseByte((uint8_t)index);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t frames = 1000000;
+  unsigned repeats = 5;
+  uint8_t buffer[16];
+  size_t variant;
+  int counter;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        frames = (uint32_t)strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        repeats = (unsigned)strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Aufruf: encodebench [-n messungen] [-r wiederholungen]\n");
+        return 2;
+    }
+  }
+  if (!frames || !repeats) return 2;
+
+  initValues();
+  counter = openInstructionCounter();
+  printf("%-20s %10s %14s %8s %10s\n", "Variante", "ns/Nachr.", "Befehle/Nachr.", "Bytes",
+         "Prfsumme");
+
+  for (variant = 0; variant < sizeof(variants) / sizeof(variants[0]); variant++)
+  {
+    double bestTime = 1e30;
+    uint64_t bestInstructions = 0;
+    uint64_t bytes = 0;
+    uint32_t checksum = 0;
+    unsigned repeat;
+
+    for (repeat = 0; repeat < repeats; repeat++)
+    {
+      uint64_t instructions = 0;
+      double start;
+      double time;
+      uint32_t timecode;
+
+      memset(&deltaEncoder, 0, sizeof(deltaEncoder));
+      bytes = 0;
+      checksum = 0;
+      if (counter >= 0)
+      {
+        ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+      }
+      start = now();
+      for (timecode = 0; timecode < frames; timecode++)
+      {
+        uint8_t len = variants[variant].encode(timecode, values[timecode & (VALUE_COUNT-1)],
+                                               buffer);
+        uint8_t count;
+        bytes += len;
+        for (count = 0; count < len; count++) checksum = checksum * 31 + buffer[count];
+      }
+      time = now() - start;
+      if (counter >= 0)
+      {
+        ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter, &instructions, sizeof(instructions)) != sizeof(instructions))
+        {
+          instructions = 0;
+        }
+      }
+      if (time < bestTime)
+      {
+        bestTime = time;
+        bestInstructions = instructions;
+      }
+    }
+
+    printf("%-20s %10.2f ", variants[variant].name, bestTime * 1e9 / frames);
+    if (counter >= 0) printf("%14.1f ", (double)bestInstructions / frames);
+    else printf("%14s ", "n/a");
+    printf("%8.2f %10x\n", (double)bytes / frames, checksum);
+  }
+  if (counter >= 0) close(counter);
+  return 0;
+}